@@ -0,0 +1,76 @@
+#########################################################
+# @file    depthtest.py
+# @brief   Test that deeply nested expressions compile in linear time.
+#########################################################
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ALANC = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+		"..", "alan", "bin", "alanc")
+
+# the depths compared; linear time takes four times as long for the second
+DEPTHS = (25000, 100000)
+# the most the time may grow between them before it counts as worse than linear
+MAX_GROWTH = 8.0
+
+'''The expressions tried, each as a function of its depth'''
+EXPRESSIONS = {
+	"sum": lambda n: "(y + " * n + "1" + ")" * n,
+	"difference": lambda n: "(y - " * n + "1" + ")" * n,
+	"left sum": lambda n: "(" * n + "y" + " + 1)" * n,
+	"index": lambda n: "a[y - 1 + " * n + "0" + "]" * n,
+}
+
+'''Writes a program that assigns the expression, and returns how long it takes to compile'''
+def compile_time(directory, name, expr):
+	source = os.path.join(directory, name + ".alan")
+	f = open(source, "w")
+	f.write("source %s\nbegin\n    integer x, y;\n    integer array a;\n" % name)
+	f.write("    a := array 2;\n    y := 1;\n    x := %s;\n    put x\nend\n" % expr)
+	f.close()
+
+	# only the Jasmin file is needed, so Jasmin itself is not run
+	env = dict(os.environ, JASMIN_JAR=os.path.join(directory, "none.jar"))
+	start = time.time()
+	subprocess.call([ALANC, source], cwd=directory, env=env,
+			stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	elapsed = time.time() - start
+	target = os.path.join(directory, name + ".jasmin")
+	if not os.path.exists(target):
+		return None
+	os.remove(target)
+	return elapsed
+
+'''Compiles every expression at both depths and compares the times'''
+def test_depth():
+	is_valid = True
+	directory = tempfile.mkdtemp()
+	for kind, make in sorted(EXPRESSIONS.items()):
+		times = []
+		for n in DEPTHS:
+			times.append(compile_time(directory, "depth%d" % n, make(n)))
+		if None in times:
+			print("The %s expression does not compile." % kind)
+			is_valid = False
+			continue
+		growth = times[1] / max(times[0], 0.001)
+		print("%-10s %6d levels %.3f s, %6d levels %.3f s" %
+				(kind, DEPTHS[0], times[0], DEPTHS[1], times[1]))
+		if growth > MAX_GROWTH:
+			print("The %s expression takes %.1f times as long at %d levels." %
+					(kind, growth, DEPTHS[1]))
+			is_valid = False
+	os.system('rm -rf %s' % directory)
+	return is_valid
+
+if __name__ == "__main__":
+	if len(sys.argv) > 1:
+		ALANC = sys.argv[1]
+	if test_depth():
+		print("Compile time grows linearly with depth.")
+	else:
+		sys.exit(1)
@@ -0,0 +1,87 @@
+#########################################################
+# @file    vartest.py
+# @brief   Test that variables sharing a slot are listed apart.
+#########################################################
+
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+TESTS = os.path.dirname(os.path.abspath(__file__))
+ALANC = os.path.join(TESTS, "..", "alan", "bin", "alanc")
+
+'''Compiles a program to Jasmin only, and returns the Jasmin file, or None if it does not compile'''
+def compile_program(directory, source):
+	name = os.path.basename(source)[:-len(".alan")]
+	env = dict(os.environ, JASMIN_JAR=os.path.join(directory, "none.jar"))
+	subprocess.call([ALANC, source], cwd=directory, env=env,
+			stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+	target = os.path.join(directory, name + ".jasmin")
+	if not os.path.exists(target):
+		return None
+	return target
+
+'''Checks the local variable table of every method, and returns the number of faults'''
+def check_variables(target):
+	faults = 0
+	method = None
+	for line in open(target):
+		line = line.rstrip("\n")
+		if line.startswith(".method"):
+			method = line.split()[-1]
+			place = {"Begin": -1}
+			entries = []
+		elif method is None:
+			continue
+		elif re.match(r"^(P\d+|Finish):$", line):
+			place[line[:-1]] = len(place)
+		elif line.startswith(".var"):
+			m = re.match(r"\.var (\d+) is '([^']*)' \S+ from (\w+) to (\w+)$",
+					line)
+			entries.append((int(m.group(1)), m.group(2), m.group(3),
+				m.group(4)))
+		elif line.startswith(".end method"):
+			spans = {}
+			for slot, name, start, end in entries:
+				if start not in place or end not in place \
+						or place[start] >= place[end]:
+					print("%s: %s: '%s' from %s to %s is not a range" %
+							(os.path.basename(target), method, name, start, end))
+					faults += 1
+					continue
+				spans.setdefault(slot, []).append(
+						(place[start], place[end], name, start, end))
+			for slot in spans:
+				spans[slot].sort()
+				for a, b in zip(spans[slot], spans[slot][1:]):
+					if b[0] < a[1]:
+						print("%s: %s: slot %d holds '%s' from %s to %s and "
+								"'%s' from %s to %s" %
+								((os.path.basename(target), method, slot)
+									+ a[2:] + b[2:]))
+						faults += 1
+			method = None
+	return faults
+
+'''Compiles every test program, and checks its local variable tables'''
+def test_variables():
+	faults = 0
+	directory = tempfile.mkdtemp()
+	for source in sorted(glob.glob(os.path.join(TESTS, "*", "test*.alan"))):
+		target = compile_program(directory, source)
+		if target is not None:
+			faults += check_variables(target)
+			os.remove(target)
+	os.system('rm -rf %s' % directory)
+	return faults == 0
+
+if __name__ == "__main__":
+	if len(sys.argv) > 1:
+		ALANC = sys.argv[1]
+	if test_variables():
+		print("No two variables in a slot overlap.")
+	else:
+		sys.exit(1)
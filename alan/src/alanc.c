@@ -17,11 +17,14 @@
 /* Include the appropriate system and project header files. */
 
 #include <ctype.h>
+#include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include "boolean.h"
 #include "error.h"
+#include "jobs.h"
 #include "scanner.h"
 #include "token.h"
 #include <stdio.h>
@@ -43,6 +46,19 @@ struct variable_s {
 	Variable  *next;   /**< pointer to the next variable in the list  */
 };
 
+/* the iterations of a parallel loop may run in any order, or at the same
+ * time, so that none of them may use an array element that another stores
+ */
+typedef struct array_use_s ArrayUse;
+struct array_use_s {
+	char         *id;      /**< the identifier of the array               */
+	unsigned int  offset;  /**< the slot of the array                     */
+	Boolean       stored;  /**< whether its elements are stored into      */
+	Boolean       shared;  /**< whether it is used other than at the loop
+	                            index                                     */
+	ArrayUse     *next;    /**< pointer to the next array in the list     */
+};
+
 /* --- debugging ------------------------------------------------------------ */
 
 /*  Your Makefile has a variable called DFLAGS.  If it is set to contain
@@ -67,11 +83,65 @@ void debug_info(const char *fmt, ...);
 #define DBG_info(...)
 #endif /* DEBUG_PARSER */
 
+/* --- deep nesting -------------------------------------------------------- */
+
+/* the parse routines recurse once for every level of nesting in the source;
+ * after DEEP_NESTING levels on one stack, the parse continues on a fresh one
+ * of STACK_SEGMENT bytes, so that the depth of nesting is bounded by memory,
+ * rather than by the stack of the process
+ */
+#define DEEP_NESTING   1000
+#define STACK_SEGMENT  (16 * 1024 * 1024)
+
+/* --- command-line options ------------------------------------------------- */
+
+#define USAGE \
+	"usage: %s [--jobs=<n>] [--launcher] [--list-removed] [--memoize]" \
+	" [--parallel] [--profile] [--stream] [--unroll=<factor>]" \
+	" [--use-profile=<file>] <filename>"
+
+#define DEFAULT_UNROLL  4   /* the default loop unrolling factor      */
+#define MAX_UNROLL      16  /* the largest accepted unrolling factor */
+#define MAX_JOBS        64  /* the most threads to compile with       */
+
+enum {
+	OPT_JOBS = 256,
+	OPT_LAUNCHER,
+	OPT_LIST_REMOVED,
+	OPT_MEMOIZE,
+	OPT_PARALLEL,
+	OPT_PROFILE,
+	OPT_STREAM,
+	OPT_UNROLL,
+	OPT_USE_PROFILE
+};
+
+static struct option options[] = {
+	{ "jobs",         required_argument, NULL, OPT_JOBS         },
+	{ "launcher",     no_argument,       NULL, OPT_LAUNCHER     },
+	{ "list-removed", no_argument,       NULL, OPT_LIST_REMOVED },
+	{ "memoize",      no_argument,       NULL, OPT_MEMOIZE      },
+	{ "parallel",     no_argument,       NULL, OPT_PARALLEL     },
+	{ "profile",      no_argument,       NULL, OPT_PROFILE      },
+	{ "stream",       no_argument,       NULL, OPT_STREAM       },
+	{ "unroll",       required_argument, NULL, OPT_UNROLL       },
+	{ "use-profile",  required_argument, NULL, OPT_USE_PROFILE  },
+	{ NULL,           0,                 NULL, 0                }
+};
+
 /* --- global variables ----------------------------------------------------- */
 
 Token    token;        /**< the lookahead token.type                */
 FILE    *src_file;     /**< the source code file                    */
 ValType  return_type;  /**< the return type of the current function */
+int      nesting;      /**< the nesting depth of statement lists    */
+int      statements;   /**< the statements so far in this function  */
+int      loop_offset;  /**< the parallel loop variable slot, or -1  */
+ArrayUse *array_uses;  /**< the arrays used in the parallel loop    */
+Boolean  lone_slice;   /**< whether a slice may stand alone next    */
+int      depth;        /**< the nesting depth of the parse routines */
+int      stack_base;   /**< the depth at the start of this stack    */
+int      operations;   /**< the operations being parsed             */
 
 /* Uncomment the previous definition for use during type checking. */
 
@@ -91,10 +161,11 @@ void parse_if(void);
 void parse_input(void);
 void parse_leave(void);
 void parse_output(void);
+void parse_parallel(void);
 void parse_while(void);
 void parse_expr(ValType *type);
 void parse_simple(ValType *type);
-void parse_term(ValType *type);
+void parse_operation(ValType *type, int power);
 void parse_factor(ValType *type);
 
 /* --- helper macros -------------------------------------------------------- */
@@ -109,20 +180,8 @@ void parse_factor(ValType *type);
 	toktype == TOKEN_FALSE || toktype == TOKEN_NOT || \
 	toktype == TOKEN_NUMBER || toktype == TOKEN_OPEN_PARENTHESIS)
 
-#define IS_ADDOP(toktype) \
-	(toktype >= TOKEN_MINUS && toktype <= TOKEN_PLUS)
-
-#define IS_MULOP(toktype) \
-	(toktype == TOKEN_AND || toktype == TOKEN_MULTIPLY || \
-	toktype == TOKEN_DIVIDE ||toktype == TOKEN_REMAINDER)
-
 #define IS_ORDOP(toktype) \
 
-#define IS_RELOP(toktype) \
-	(toktype == TOKEN_EQUAL || toktype == TOKEN_GREATER_EQUAL || \
-	toktype == TOKEN_GREATER_THAN || toktype == TOKEN_LESS_EQUAL || \
-	toktype == TOKEN_LESS_THAN || toktype == TOKEN_NOT_EQUAL)
-
 
 #define IS_TYPE_TOKEN(toktype) \
 	(toktype == TOKEN_BOOLEAN || toktype == TOKEN_INTEGER)
@@ -130,7 +189,37 @@ void parse_factor(ValType *type);
 #define IS_TYPE_STATEMENT(toktype) \
 	(toktype == TOKEN_ID || toktype == TOKEN_CALL || toktype == TOKEN_IF || \
 	toktype == TOKEN_GET || toktype == TOKEN_LEAVE || toktype == TOKEN_PUT || \
-	toktype == TOKEN_WHILE)
+	toktype == TOKEN_WHILE || toktype == TOKEN_PARALLEL)
+
+/* --- operator table ------------------------------------------------------- */
+
+/* the binding powers of the binary operators, from the loosest to the
+ * tightest; a token that is not a binary operator has no power
+ */
+#define POWER_RELATIONAL     1
+#define POWER_ADDITIVE       2
+#define POWER_MULTIPLICATIVE 3
+
+typedef struct {
+	int       power;   /**< the binding power, or 0                      */
+	Bytecode  opcode;  /**< the instruction, or the jump of a comparison */
+} Operator;
+
+static const Operator operators[TOKEN_SEMICOLON + 1] = {
+	[TOKEN_EQUAL]         = { POWER_RELATIONAL,     JVM_IF_ICMPEQ },
+	[TOKEN_GREATER_EQUAL] = { POWER_RELATIONAL,     JVM_IF_ICMPGE },
+	[TOKEN_GREATER_THAN]  = { POWER_RELATIONAL,     JVM_IF_ICMPGT },
+	[TOKEN_LESS_EQUAL]    = { POWER_RELATIONAL,     JVM_IF_ICMPLE },
+	[TOKEN_LESS_THAN]     = { POWER_RELATIONAL,     JVM_IF_ICMPLT },
+	[TOKEN_NOT_EQUAL]     = { POWER_RELATIONAL,     JVM_IF_ICMPNE },
+	[TOKEN_MINUS]         = { POWER_ADDITIVE,       JVM_ISUB      },
+	[TOKEN_OR]            = { POWER_ADDITIVE,       JVM_IOR       },
+	[TOKEN_PLUS]          = { POWER_ADDITIVE,       JVM_IADD      },
+	[TOKEN_AND]           = { POWER_MULTIPLICATIVE, JVM_IAND      },
+	[TOKEN_DIVIDE]        = { POWER_MULTIPLICATIVE, JVM_IDIV      },
+	[TOKEN_MULTIPLY]      = { POWER_MULTIPLICATIVE, JVM_IMUL      },
+	[TOKEN_REMAINDER]     = { POWER_MULTIPLICATIVE, JVM_IREM      }
+};
 
 /* --- function prototypes: helper routines --------------------------------- */
 
@@ -139,8 +228,14 @@ void parse_factor(ValType *type);
  */
 
 void check_types(ValType type1, ValType type2, SourcePos *pos, ...);
+void descend(void *(*parse)(void *), void *arg);
 void expect(TokenType type);
 void expect_id(char **id);
+void forbid_in_loop(const char *fmt, const char *id);
+void forbid_slice(ValType type, TokenType op, SourcePos *pos);
+void *resume_factor(void *type);
+void *resume_statements(void *arg);
+void use_array(const char *id, IDprop *p, Boolean store, Boolean at_index);
 IDprop *idprop(ValType type, unsigned int offset, unsigned int nparams,
 		ValType *params);
 Variable *variable(char *id, ValType type, SourcePos pos);
@@ -157,6 +252,11 @@ int main(int argc, char *argv[])
 #if 1
 	char *jasmin_path;
 #endif
+	char *end, *profile_path = NULL;
+	int opt;
+	long jobs = 1, unroll = DEFAULT_UNROLL;
+	Boolean launcher = FALSE, list_removed = FALSE, memoise = FALSE;
+	Boolean parallel = FALSE, profile = FALSE, stream = FALSE;
 
 	/* Uncomment the previous definition for code generation. */
 
@@ -164,8 +264,55 @@ int main(int argc, char *argv[])
 	setprogname(argv[0]);
 
 	/* check command-line arguments and environment */
-	if (argc != 2) {
-		eprintf("usage: %s <filename>", getprogname());
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (opt) {
+			case OPT_JOBS:
+				jobs = strtol(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' || jobs < 1
+						|| jobs > MAX_JOBS) {
+					eprintf("invalid number of jobs '%s'", optarg);
+				}
+				break;
+			case OPT_LAUNCHER:
+				launcher = TRUE;
+				break;
+			case OPT_LIST_REMOVED:
+				list_removed = TRUE;
+				break;
+			case OPT_MEMOIZE:
+				memoise = TRUE;
+				break;
+			case OPT_PARALLEL:
+				parallel = TRUE;
+				break;
+			case OPT_PROFILE:
+				profile = TRUE;
+				break;
+			case OPT_STREAM:
+				stream = TRUE;
+				break;
+			case OPT_UNROLL:
+				unroll = strtol(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' || unroll < 1
+						|| unroll > MAX_UNROLL) {
+					eprintf("invalid unrolling factor '%s'", optarg);
+				}
+				break;
+			case OPT_USE_PROFILE:
+				profile_path = optarg;
+				break;
+			default:
+				eprintf(USAGE, getprogname());
+		}
+	}
+	if (argc - optind != 1) {
+		eprintf(USAGE, getprogname());
+	}
+	if (stream && memoise) {
+		weprintf("--memoize is ignored with --stream");
+	}
+	if (stream && list_removed) {
+		weprintf("--list-removed is ignored with --stream");
 	}
 
 	/* Uncomment the following for code generation */
@@ -175,17 +322,31 @@ int main(int argc, char *argv[])
 	}
 
 	/* open the source file, and report an error if it cannot be opened */
-	if ((src_file = fopen(argv[1], "r")) == NULL) {
-		eprintf("file '%s' could not be opened:", argv[1]);
+	if ((src_file = fopen(argv[optind], "r")) == NULL) {
+		eprintf("file '%s' could not be opened:", argv[optind]);
 	}
-	setsrcname(argv[1]);
+	setsrcname(argv[optind]);
 
 	/* initialise all compiler units */
 	init_scanner(src_file);
+	set_parallel_loops(parallel);
+	set_scanning_jobs((int) jobs);
+	init_jobs((int) jobs);
 	init_symbol_table();
 	init_code_generation();
+	set_unroll_factor((int) unroll);
+	set_list_removed(list_removed);
+	set_memoisation(memoise);
+	set_parallel_code(parallel);
+	set_profiling(profile);
+	set_streaming(stream);
+	if (profile_path != NULL) {
+		read_profile(profile_path);
+	}
 
 	/* compile */
+	loop_offset = -1;
+	array_uses = NULL;
 	get_token(&token);
 	parse_source();
 
@@ -194,11 +355,15 @@ int main(int argc, char *argv[])
 
 	make_code_file();
 	assemble(jasmin_path);
+	if (launcher) {
+		make_launcher();
+	}
 
 	/* release allocated resources */
 	/* Release the resources of the symbol table and code generation. */
 	release_symbol_table();
 	release_code_generation();
+	release_jobs();
 	fclose(src_file);
 	freeprogname();
 	freesrcname();
@@ -238,6 +403,8 @@ void parse_source(void)
 	}
 
 	init_subroutine_codegen("main", idprop(TYPE_CALLABLE, 0, 0, NULL));
+	statements = 0;
+	return_type = TYPE_CALLABLE;
 	parse_body();
 	gen_1(JVM_RETURN);
 	close_subroutine_codegen(get_variables_width());
@@ -260,62 +427,70 @@ void parse_source(void)
 
 void parse_funcdef(void)
 {
-	char *fname;
-	ValType vt;
+	char *fname, *tname;
+	ValType vt, *v;
+	Variable *head, *tail, *next;
+	unsigned int numparams = 0, i, offset;
+
 	expect(TOKEN_FUNCTION);
 	expect_id(&fname);
-	char *function = fname;
 	expect(TOKEN_OPEN_PARENTHESIS);
-	Variable *next, *prev;
-	unsigned int numparams = 0;
+
+	head = tail = NULL;
 	if (IS_TYPE_TOKEN(token.type)) {
-		char *tname;
 		parse_type(&vt);
 		expect_id(&tname);
-		next = variable(tname, vt, position);
-		prev = next;
+		head = tail = variable(tname, vt, position);
 		numparams++;
 
 		while (token.type == TOKEN_COMMA) {
-			char *t2name;
-			ValType vt2;
 			expect(TOKEN_COMMA);
-			parse_type(&vt2);
-			expect_id(&t2name);
-			next->next = variable(t2name, vt2, position);
+			parse_type(&vt);
+			expect_id(&tname);
+			tail->next = variable(tname, vt, position);
+			tail = tail->next;
 			numparams++;
 		}
 	}
 
 	expect(TOKEN_CLOSE_PARENTHESIS);
 
+	return_type = TYPE_NONE;
 	if (token.type == TOKEN_TO) {
 		expect(TOKEN_TO);
 		parse_type(&return_type);
-		ValType *v = (ValType*) malloc(numparams * sizeof(ValType));
-		unsigned int i;
-		for (i = 0; i < numparams; i++) {
-			v[i] = next->type;
-			next = next->next;
-		}
+	}
+	SET_AS_CALLABLE(return_type);
 
-		SET_AS_CALLABLE(return_type);
-		open_subroutine(function, idprop(return_type, get_variables_width(), numparams, v));
-		init_subroutine_codegen(function, idprop(return_type, get_variables_width(), numparams, v));
-		next = prev;
+	v = emalloc(numparams * sizeof(ValType));
+	for (i = 0, next = head; next != NULL; i++, next = next->next) {
+		v[i] = next->type;
+	}
 
-		while (next != NULL) {
-			if (!insert_name(next->id, idprop(next->type, get_variables_width(), 0, NULL))) {
-				leprintf("multiple defenition of %s", next->id);
-			}
+	init_subroutine_codegen(fname, idprop(return_type, 0, numparams, v));
+	statements = 0;
+	if (!open_subroutine(fname, idprop(return_type, 0, numparams, v))) {
+		leprintf("multiple defenition of %s", fname);
+	}
 
-			next = next->next;
+	/* the parameters occupy the first local variable slots, in order */
+	while (head != NULL) {
+		offset = get_variables_width();
+		if (!insert_name(head->id, idprop(head->type, offset, 0, NULL))) {
+			leprintf("multiple defenition of %s", head->id);
 		}
-
+		declare_variable(head->id, head->type, offset);
+		next = head->next;
+		free(head);
+		head = next;
 	}
+
 	parse_body();
-	close_subroutine();
+	if (return_type == TYPE_CALLABLE) {
+		gen_1(JVM_RETURN);
+	}
 	close_subroutine_codegen(get_variables_width());
+	close_subroutine();
 }
 
 /*
@@ -368,21 +543,26 @@ void parse_vardef(void)
 {
 	char *vname;
 	ValType v;
+	unsigned int offset;
 
 	parse_type(&v);
 	expect_id(&vname);
 
-	if (!insert_name(vname, idprop(v, get_variables_width(), 0, NULL))) {
+	offset = get_variables_width();
+	if (!insert_name(vname, idprop(v, offset, 0, NULL))) {
 		leprintf("multiple defenition of %s", vname);
 	}
+	declare_variable(vname, v, offset);
 
 	while (token.type == TOKEN_COMMA) {
 		get_token(&token);
 		expect_id(&vname);
 
-		if (!insert_name(vname, idprop(v, get_variables_width(), 0, NULL))) {
+		offset = get_variables_width();
+		if (!insert_name(vname, idprop(v, offset, 0, NULL))) {
 			leprintf("multiple defenition of %s", vname);
 		}
+		declare_variable(vname, v, offset);
 	}
 	expect(TOKEN_SEMICOLON);
 }
@@ -392,6 +572,20 @@ void parse_vardef(void)
  */
 void parse_statements(void)
 {
+	if (depth - stack_base >= DEEP_NESTING) {
+		descend(resume_statements, NULL);
+		return;
+	}
+	depth++;
+
+	/* statements at the top level of a body are marked, so that the body may
+	 * be split between them
+	 */
+	nesting++;
+	if (nesting == 1) {
+		gen_mark();
+	}
+
 	if (token.type == TOKEN_RELAX) {
 		expect(TOKEN_RELAX);
 	}
@@ -405,16 +599,45 @@ void parse_statements(void)
 
 	while (token.type == TOKEN_SEMICOLON) {
 		expect(TOKEN_SEMICOLON);
+		if (nesting == 1) {
+			gen_mark();
+		}
 		parse_statement();
 	}
+
+	if (nesting == 1) {
+		gen_mark();
+	}
+	nesting--;
+	depth--;
 }
 
 /*
  * <statement> = <assign> | <call> | <if> | <input> | <leave> | <output> |
- * <while>.
+ * <while> | <parallel>.
  */
 void parse_statement(void)
 {
+	statements++;
+	gen_line(position.line);
+
+	switch (token.type) {
+		case TOKEN_GET:
+			forbid_in_loop("input", NULL);
+			break;
+		case TOKEN_LEAVE:
+			forbid_in_loop("leave", NULL);
+			break;
+		case TOKEN_PARALLEL:
+			forbid_in_loop("nested parallel loop", NULL);
+			break;
+		case TOKEN_PUT:
+			forbid_in_loop("output", NULL);
+			break;
+		default:
+			break;
+	}
+
 	switch (token.type) {
 		case TOKEN_ID:
 			parse_assign();
@@ -444,41 +667,93 @@ void parse_statement(void)
 			parse_while();
 			break;
 
+		case TOKEN_PARALLEL:
+			parse_parallel();
+			break;
+
 		default: abort_compile(ERR_STATEMENT_EXPECTED, token.type);
 			break;
 	}
 }
 
 /*
- * <assign> = <id> ["[" <simple> "]"] ":=" (<expr>) | "array" <simple>).
+ * <assign> = <id> ["[" <simple> [".." <simple>] "]"] ":=" (<expr>) |
+ * "array" <simple>).
  */
 void parse_assign(void)
 {
 	char *aname;
-	ValType type;
+	ValType type, element;
+	IDprop *p;
+	int index;
+	Boolean slice = FALSE;
+	SourcePos pos;
 	expect_id(&aname);
 
 	if (token.type == TOKEN_OPEN_BRACKET) {
 		expect(TOKEN_OPEN_BRACKET);
 
-		IDprop *p;
 		if (find_name(aname, &p)) {
 			gen_2(JVM_ALOAD, p->offset);
 		}
 
+		index = get_ip();
 		parse_simple(&type);
+
+		/* a slice is passed on as its array, its start, and its end, just
+		 * past the last element
+		 */
+		if (token.type == TOKEN_RANGE) {
+			expect(TOKEN_RANGE);
+			parse_simple(&type);
+			gen_2(JVM_LDC, 1);
+			gen_1(JVM_IADD);
+			forbid_in_loop("store into a slice of '%s'", aname);
+			slice = TRUE;
+		}
 		expect(TOKEN_CLOSE_BRACKET);
+
+		/* every iteration of a parallel loop stores into its own element */
+		if (loop_offset >= 0) {
+			if (!loads_variable(index, loop_offset)) {
+				forbid_in_loop("store into '%s' other than at the loop index",
+						aname);
+			}
+			use_array(aname, p, TRUE, TRUE);
+		}
+
+	} else {
+		/* the iterations would share a scalar, so that none may set it */
+		forbid_in_loop("assignment to '%s'", aname);
 	}
 
 	expect(TOKEN_GETS);
 
-	if (STARTS_EXPR(token.type)) {
+	/* a slice is either filled with a value, or copied from another slice */
+	if (slice) {
+		lone_slice = TRUE;
+		pos = position;
+		parse_expr(&type);
+		if (find_name(aname, &p)) {
+			element = p->type;
+			SET_BASE_TYPE(element);
+			if (IS_SLICE_TYPE(type)) {
+				SET_AS_SLICE(element);
+				check_types(type, element, &pos, "for copy into '%s'", aname);
+				gen_copy();
+			} else {
+				check_types(type, element, &pos, "for fill of '%s'", aname);
+				gen_fill(element);
+			}
+		}
+
+	} else if (STARTS_EXPR(token.type)) {
 		parse_expr(&type);
 		IDprop *p;
 		if (find_name(aname, &p)) {
 
 			if (IS_ARRAY_TYPE(p->type)) {
-				gen_1(JVM_IASTORE);
+				gen_1(IS_BOOLEAN_TYPE(p->type) ? JVM_BASTORE : JVM_IASTORE);
 			} else {
 				gen_2(JVM_ISTORE, p->offset);
 			}
@@ -490,7 +765,7 @@ void parse_assign(void)
 		IDprop *p;
 		if (find_name(aname, &p)) {
 			if (IS_BOOLEAN_TYPE(p->type)) {
-				gen_newarray(T_INT);
+				gen_newarray(T_BOOLEAN);
 			} else if (IS_INTEGER_TYPE(p->type)) {
 				gen_newarray(T_INT);
 			}
@@ -516,6 +791,9 @@ void parse_call(void)
 	expect(TOKEN_CALL);
 	expect_id(&cname);
 	expect(TOKEN_OPEN_PARENTHESIS);
+	if (!is_pure(cname)) {
+		forbid_in_loop("call of '%s', which is not pure,", cname);
+	}
 
 	if (STARTS_EXPR(token.type)) {
 		parse_expr(&type);
@@ -541,14 +819,27 @@ void parse_call(void)
 void parse_if(void)
 {
 	Label start, end, next;
+	int statement, ntests, maxtests, *starts, *ends, other, finish;
+	statement = statements;
 	start = get_label();
 	end = get_label();
 	next = get_label();
 
+	/* remember where each test is, so that a chain of comparisons against
+	 * constants can be turned into a switch afterwards
+	 */
+	ntests = 0;
+	maxtests = 8;
+	starts = emalloc(maxtests * sizeof(int));
+	ends = emalloc(maxtests * sizeof(int));
+
 	ValType type;
 	expect(TOKEN_IF);
+	starts[ntests] = get_ip();
 	parse_expr(&type);
 	gen_2_label(JVM_IFEQ, next);
+	ends[ntests] = get_ip();
+	gen_arm(statement, ntests++);
 	expect(TOKEN_THEN);
 	parse_statements();
 	gen_2_label(JVM_GOTO, end);
@@ -557,43 +848,96 @@ void parse_if(void)
 	while (token.type == TOKEN_ELSIF) {
 		start = get_label();
 		expect(TOKEN_ELSIF);
+		if (ntests == maxtests) {
+			maxtests *= 2;
+			starts = erealloc(starts, maxtests * sizeof(int));
+			ends = erealloc(ends, maxtests * sizeof(int));
+		}
+		starts[ntests] = get_ip();
 		parse_expr(&type);
 		gen_2_label(JVM_IFEQ, start);
+		ends[ntests] = get_ip();
+		gen_arm(statement, ntests++);
 		expect(TOKEN_THEN);
 		parse_statements();
 		gen_2_label(JVM_GOTO, end);
 		gen_label(start);
 	}
 
+	/* the else arm is counted even if it is missing */
+	other = get_ip();
+	gen_arm(statement, ntests);
 	if (token.type == TOKEN_ELSE) {
 		expect(TOKEN_ELSE);
 		parse_statements();
 	}
+	finish = get_ip();
 
 	gen_label(end);
 	expect(TOKEN_END);
+
+	if (!gen_switch(ntests, starts, ends)) {
+		arrange_arms(statement, ntests, starts, ends, other, finish);
+	}
+	free(starts);
+	free(ends);
 }
 
 /*
- * <input> = “get” <id> ["[" <simple> "]"].
+ * <input> = “get” <id> ["[" <simple> [".." <simple>] "]"].
  */
 void parse_input(void)
 {
 	char *iname;
 	ValType type;
+	IDprop *p;
+	Boolean found, indexed = FALSE, slice = FALSE;
+	SourcePos pos;
 	expect(TOKEN_GET);
+	pos = position;
 	expect_id(&iname);
+	found = find_name(iname, &p);
 
 	if (token.type == TOKEN_OPEN_BRACKET) {
+		if (found && !IS_ARRAY(p->type)) {
+			abort_compile_pos(&pos, ERR_NOT_AN_ARRAY, iname);
+		}
 		expect(TOKEN_OPEN_BRACKET);
+		if (found) {
+			gen_2(JVM_ALOAD, p->offset);
+		}
 		parse_simple(&type);
+		if (token.type == TOKEN_RANGE) {
+			expect(TOKEN_RANGE);
+			parse_simple(&type);
+			gen_2(JVM_LDC, 1);
+			gen_1(JVM_IADD);
+			slice = TRUE;
+		}
 		expect(TOKEN_CLOSE_BRACKET);
+		indexed = TRUE;
+	} else if (found && IS_ARRAY(p->type)) {
+		gen_2(JVM_ALOAD, p->offset);
 	}
 
-	IDprop *p;
-	if (find_name(iname, &p)) {
-		gen_read(p->type);
-		gen_2(JVM_ISTORE, p->offset);
+	/* an array, or a slice of one, is read an element at a time */
+	if (found && IS_ARRAY(p->type) && (slice || !indexed)) {
+		type = p->type;
+		if (slice) {
+			SET_BASE_TYPE(type);
+			SET_AS_SLICE(type);
+		}
+		gen_read(type);
+
+	} else if (found) {
+		type = p->type;
+		SET_BASE_TYPE(type);
+		gen_read(type);
+		if (IS_ARRAY_TYPE(p->type)) {
+			gen_1(IS_BOOLEAN_TYPE(p->type) ? JVM_BASTORE : JVM_IASTORE);
+		} else {
+			gen_2(JVM_ISTORE, p->offset);
+		}
 	}
 
 	free(iname);
@@ -609,7 +953,9 @@ void parse_leave(void)
 
 	if (STARTS_EXPR(token.type)) {
 		parse_expr(&type);
-		gen_1(JVM_IRETURN);
+		gen_1(IS_ARRAY_TYPE(return_type) ? JVM_ARETURN : JVM_IRETURN);
+	} else {
+		gen_1(JVM_RETURN);
 	}
 }
 
@@ -622,10 +968,11 @@ void parse_output(void)
 	expect(TOKEN_PUT);
 
 	if (token.type == TOKEN_STRING) {
-		gen_print_string(token.string);
+		gen_print_string(copy_lexeme(&token));
 		expect(TOKEN_STRING);
 
 	} else if (STARTS_EXPR(token.type)) {
+		lone_slice = TRUE;
 		parse_expr(&type);
 		gen_print(type);
 
@@ -637,11 +984,12 @@ void parse_output(void)
 		expect(TOKEN_CONCATENATE);
 
 		if (token.type == TOKEN_STRING) {
-		gen_print_string(token.string);
+		gen_print_string(copy_lexeme(&token));
 			expect(TOKEN_STRING);
 		}
 
 		else if (STARTS_EXPR(token.type)) {
+			lone_slice = TRUE;
 			parse_expr(&type);
 			gen_print(type);
 		} else {
@@ -650,23 +998,78 @@ void parse_output(void)
 	}
 }
 
+/*
+ * <parallel> = "parallel" <id> ":=" <simple> "to" <simple> "do" <statements>
+ * "end".
+ */
+void parse_parallel(void)
+{
+	char *lname;
+	IDprop *p;
+	ValType type;
+	SourcePos pos;
+	ArrayUse *u;
+	int body;
+
+	expect(TOKEN_PARALLEL);
+	pos = position;
+	expect_id(&lname);
+	if (!find_name(lname, &p)) {
+		abort_compile_pos(&pos, ERR_UNKNOWN_IDENTIFIER, lname);
+	}
+	check_types(p->type, TYPE_INTEGER, &pos, "for parallel loop variable '%s'",
+			lname);
+
+	/* the bounds are evaluated once, before any iteration */
+	expect(TOKEN_GETS);
+	parse_simple(&type);
+	expect(TOKEN_TO);
+	parse_simple(&type);
+	expect(TOKEN_DO);
+
+	body = get_ip();
+	loop_offset = (int) p->offset;
+	parse_statements();
+	loop_offset = -1;
+	gen_parallel(body, p->offset);
+	expect(TOKEN_END);
+
+	while (array_uses != NULL) {
+		u = array_uses->next;
+		free(array_uses->id);
+		free(array_uses);
+		array_uses = u;
+	}
+	free(lname);
+}
+
 /*
  * <while> = “while” <expr> "do" <statements> "end".
  */
 void parse_while(void)
 {
 	Label start, end;
+	int statement, test, body;
+	statement = statements;
 	start = get_label();
 	end = get_label();
 	ValType type;
 	expect(TOKEN_WHILE);
 	gen_label(start);
+	test = get_ip();
 	parse_expr(&type);
 	gen_2_label(JVM_IFEQ, end);
 	expect(TOKEN_DO);
+	body = get_ip();
+	gen_arm(statement, 0);
 	parse_statements();
 	gen_2_label(JVM_GOTO, start);
 	gen_label(end);
+
+	/* only loops that run often are worth the larger code */
+	if (is_hot(statement, 0)) {
+		unroll_loop(test, body);
+	}
 	expect(TOKEN_END);
 }
 
@@ -675,48 +1078,16 @@ void parse_while(void)
  */
 void parse_expr(ValType *type)
 {
-	parse_simple(type);
+	Boolean lone = lone_slice;
+	SourcePos start = position;
 
-	if (IS_RELOP(token.type)) {
-		switch (token.type) {
-			case TOKEN_EQUAL:
-				expect(TOKEN_EQUAL);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPEQ);
-				break;
+	lone_slice = FALSE;
+	parse_operation(type, POWER_RELATIONAL);
 
-			case TOKEN_GREATER_EQUAL:
-				expect(TOKEN_GREATER_EQUAL);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPGE);
-				break;
-
-			case TOKEN_GREATER_THAN:
-				expect(TOKEN_GREATER_THAN);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPGT);
-				break;
-
-			case TOKEN_LESS_EQUAL:
-				expect(TOKEN_LESS_EQUAL);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPLE);
-				break;
-
-			case TOKEN_LESS_THAN:
-				expect(TOKEN_LESS_THAN);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPLT);
-				break;
-
-			case TOKEN_NOT_EQUAL:
-				expect(TOKEN_NOT_EQUAL);
-				parse_simple(type);
-				gen_cmp(JVM_IF_ICMPNE);
-				break;
-			default:
-				break;
-		}
+	/* a slice stands alone only where it is copied, or written */
+	if (IS_SLICE_TYPE(*type) && !lone) {
+		abort_compile_pos(&start, ERR_ILLEGAL_ARRAY_OPERATION,
+				"slice other than in a copy, comparison or output");
 	}
 }
 
@@ -725,89 +1096,87 @@ void parse_expr(ValType *type)
  */
 void parse_simple(ValType *type)
 {
-	int min = 0;
-	if (token.type == TOKEN_MINUS) {
-		gen_2(JVM_LDC, 0);
-		expect(TOKEN_MINUS);
-		min = 1;
-	}
-
-	parse_term(type);
-	if (min == 1) {
-		gen_1(JVM_ISUB);
-	}
-
-	while (IS_ADDOP(token.type)) {
-		switch (token.type) {
-			case TOKEN_PLUS:
-				expect(TOKEN_PLUS);
-				parse_term(type);
-				gen_1(JVM_IADD);
-				break;
-
-			case TOKEN_MINUS:
-				expect(TOKEN_MINUS);
-				parse_term(type);
-				gen_1(JVM_ISUB);
-				break;
-
-			case TOKEN_OR:
-				expect(TOKEN_OR);
-				parse_term(type);
-				gen_1(JVM_IOR);
-				break;
-
-			default:
-				break;
-		}
-	}
+	parse_operation(type, POWER_ADDITIVE);
 }
 
 /*
  * <term> = <factor> {<mulop> <factor>}.
+ *
+ * Parses the part of an expression whose operators bind at least as tightly as
+ * the given power, as <expr> does for the relational power, <simple> for the
+ * additive, and <term> for the multiplicative one.  The right operand of an
+ * operator is the part whose operators bind more tightly than it does.
  */
-void parse_term(ValType *type)
+void parse_operation(ValType *type, int power)
 {
-	parse_factor(type);
-
-	while (IS_MULOP(token.type)) {
-		switch (token.type) {
-			case TOKEN_AND:
-				expect(TOKEN_AND);
-				parse_factor(type);
-				gen_1(JVM_IAND);
-				break;
-
-			case TOKEN_MULTIPLY:
-				expect(TOKEN_MULTIPLY);
-				parse_factor(type);
-				gen_1(JVM_IMUL);
-				break;
+	int left, right;
+	ValType slice;
+	TokenType op;
+	SourcePos pos = position;
+
+	operations++;
+	left = get_ip();
+	if (power <= POWER_ADDITIVE && token.type == TOKEN_MINUS) {
+		expect(TOKEN_MINUS);
+		parse_operation(type, POWER_MULTIPLICATIVE);
+		forbid_slice(*type, TOKEN_MINUS, &pos);
+		gen_1(JVM_INEG);
+	} else {
+		parse_factor(type);
+	}
 
-			case TOKEN_DIVIDE:
-				expect(TOKEN_DIVIDE);
-				parse_factor(type);
-				gen_1(JVM_IDIV);
-				break;
+	while (operators[token.type].power >= power) {
+		op = token.type;
+		pos = position;
+		right = get_ip();
+
+		/* slices are compared with one another as a whole */
+		if (IS_SLICE_TYPE(*type)
+				&& (op == TOKEN_EQUAL || op == TOKEN_NOT_EQUAL)) {
+			slice = *type;
+			expect(op);
+			parse_operation(type, POWER_ADDITIVE);
+			check_types(*type, slice, &pos, "for comparison of slices");
+			gen_equals(slice, op == TOKEN_EQUAL);
+			*type = TYPE_BOOLEAN;
+			break;
+		}
 
-			case TOKEN_REMAINDER:
-				expect(TOKEN_REMAINDER);
-				parse_factor(type);
-				gen_1(JVM_IREM);
-				break;
+		forbid_slice(*type, op, &pos);
+		expect(op);
+		parse_operation(type, operators[op].power + 1);
+		forbid_slice(*type, op, &pos);
 
-			default:
-				break;
+		/* relational operators do not associate */
+		gen_operation(operators[op].opcode, left, right);
+		if (operators[op].power == POWER_RELATIONAL) {
+			*type = TYPE_BOOLEAN;
+			break;
 		}
 	}
+
+	/* the operands of a whole expression are put in order at once */
+	if (--operations == 0) {
+		place_operands();
+	}
 }
 
 /*
- * <factor> = <id> ["[" <simple> "]"] | "(" [<expr>{"," <expr>}] ")"] | <num> |
+ * <factor> = <id> ["[" <simple> [".." <simple>] "]"] |
+ * "(" [<expr>{"," <expr>}] ")"] | <num> |
  * "(" <expr> ")" | "not" <factor> | "true" | "false".
  */
 void parse_factor(ValType *type)
 {
+	int index;
+	SourcePos pos;
+
+	if (depth - stack_base >= DEEP_NESTING) {
+		descend(resume_factor, type);
+		return;
+	}
+	depth++;
+
 	switch (token.type) {
 		char *finame;
 		case TOKEN_ID:
@@ -819,6 +1188,11 @@ void parse_factor(ValType *type)
 				if (IS_ARRAY_TYPE(p->type)) {
 					gen_2(JVM_ALOAD, p->offset);
 					*type = p->type;
+
+					/* an array passed on is used as a whole */
+					if (token.type != TOKEN_OPEN_BRACKET) {
+						use_array(finame, p, FALSE, FALSE);
+					}
 				} else {
 					if (!IS_CALLABLE_TYPE(p->type)) {
 						gen_2(JVM_ILOAD, p->offset);
@@ -830,13 +1204,36 @@ void parse_factor(ValType *type)
 
 			if (token.type == TOKEN_OPEN_BRACKET) {
 				expect(TOKEN_OPEN_BRACKET);
+				index = get_ip();
 				parse_simple(type);
-				gen_1(JVM_IALOAD);
+				if (token.type == TOKEN_RANGE) {
+					expect(TOKEN_RANGE);
+					parse_simple(type);
+					gen_2(JVM_LDC, 1);
+					gen_1(JVM_IADD);
+					use_array(finame, p, FALSE, FALSE);
+					*type = p->type;
+					SET_BASE_TYPE(*type);
+					SET_AS_SLICE(*type);
+				} else if (IS_BOOLEAN_TYPE(p->type)) {
+					use_array(finame, p, FALSE,
+							loads_variable(index, loop_offset));
+					gen_1(JVM_BALOAD);
+					*type = TYPE_BOOLEAN;
+				} else {
+					use_array(finame, p, FALSE,
+							loads_variable(index, loop_offset));
+					gen_1(JVM_IALOAD);
+					*type = TYPE_INTEGER;
+				}
 				expect(TOKEN_CLOSE_BRACKET);
 			}
 
 			if (token.type == TOKEN_OPEN_PARENTHESIS) {
 				expect(TOKEN_OPEN_PARENTHESIS);
+				if (!is_pure(finame)) {
+					forbid_in_loop("call of '%s', which is not pure,", finame);
+				}
 				if (STARTS_EXPR(token.type)) {
 					parse_expr(type);
 					while (token.type == TOKEN_COMMA) {
@@ -846,6 +1243,8 @@ void parse_factor(ValType *type)
 				}
 				expect(TOKEN_CLOSE_PARENTHESIS);
 				gen_call(finame, p);
+				*type = p->type;
+				SET_RETURN_TYPE(*type);
 			}
 			break;
 
@@ -862,8 +1261,10 @@ void parse_factor(ValType *type)
 			break;
 
 		case TOKEN_NOT:
+			pos = position;
 			expect(TOKEN_NOT);
 			parse_factor(type);
+			forbid_slice(*type, TOKEN_NOT, &pos);
 			break;
 
 		case TOKEN_TRUE:
@@ -885,6 +1286,7 @@ void parse_factor(ValType *type)
 		free(finame);
 	}
 
+	depth--;
 }
 
 /* --- helper routines ------------------------------------------------------ */
@@ -912,6 +1314,26 @@ void check_types(ValType found, ValType expected, SourcePos *pos, ...)
 	}
 }
 
+void descend(void *(*parse)(void *), void *arg)
+{
+	int base = stack_base;
+	pthread_t thread;
+	pthread_attr_t attr;
+
+	/* the thread that parses is waited for straight away, so that only one
+	 * of them ever runs, and the parser state needs no protection
+	 */
+	stack_base = depth;
+	if (pthread_attr_init(&attr) != 0
+			|| pthread_attr_setstacksize(&attr, STACK_SEGMENT) != 0
+			|| pthread_create(&thread, &attr, parse, arg) != 0
+			|| pthread_join(thread, NULL) != 0) {
+		eprintf("could not allocate a stack for deep nesting");
+	}
+	pthread_attr_destroy(&attr);
+	stack_base = base;
+}
+
 void expect(TokenType type)
 {
 	if (token.type == type) {
@@ -925,13 +1347,76 @@ void expect_id(char **id)
 {
 
 	if (token.type == TOKEN_ID) {
-		*id = strdup(token.lexeme);
+		*id = copy_lexeme(&token);
 		get_token(&token);
 	} else {
 		abort_compile(ERR_EXPECT, TOKEN_ID);
 	}
 }
 
+void forbid_in_loop(const char *fmt, const char *id)
+{
+	char buf[MAX_MESSAGE_LENGTH];
+
+	if (loop_offset >= 0) {
+		snprintf(buf, MAX_MESSAGE_LENGTH, fmt, id);
+		abort_compile(ERR_ILLEGAL_IN_PARALLEL_LOOP, buf);
+	}
+}
+
+void forbid_slice(ValType type, TokenType op, SourcePos *pos)
+{
+	if (IS_SLICE_TYPE(type)) {
+		abort_compile_pos(pos, ERR_ILLEGAL_ARRAY_OPERATION,
+				get_token_string(op));
+	}
+}
+
+void *resume_factor(void *type)
+{
+	parse_factor(type);
+	return NULL;
+}
+
+void *resume_statements(void *arg)
+{
+	(void) arg;
+	parse_statements();
+	return NULL;
+}
+
+void use_array(const char *id, IDprop *p, Boolean store, Boolean at_index)
+{
+	ArrayUse *u, *s;
+
+	if (loop_offset < 0) {
+		return;
+	}
+	for (u = array_uses; u != NULL && u->offset != p->offset; u = u->next)
+		;
+	if (u == NULL) {
+		u = emalloc(sizeof(ArrayUse));
+		u->id = estrdup(id);
+		u->offset = p->offset;
+		u->stored = u->shared = FALSE;
+		u->next = array_uses;
+		array_uses = u;
+	}
+	u->stored = u->stored || store;
+	u->shared = u->shared || !at_index;
+
+	/* any two arrays may be the same one, passed or returned under different
+	 * names, so while any is stored into, none is used elsewhere
+	 */
+	for (s = array_uses; s != NULL && !s->stored; s = s->next)
+		;
+	for (u = array_uses; s != NULL && u != NULL; u = u->next) {
+		if (u->shared) {
+			forbid_in_loop("use of '%s' other than at the loop index", u->id);
+		}
+	}
+}
+
 /* Uncomment the following two functions for use during type checking. */
 
 IDprop *idprop(ValType type, unsigned int offset, unsigned int nparams,
@@ -997,6 +1482,7 @@ void _abort_compile(SourcePos *posp, Error err, va_list args)
 
 	switch (err) {
 		case ERR_ILLEGAL_ARRAY_OPERATION:
+		case ERR_ILLEGAL_IN_PARALLEL_LOOP:
 		case ERR_MULTIPLE_DEFINITION:
 		case ERR_NOT_A_FUNCTION:
 		case ERR_NOT_A_PROCEDURE:
@@ -1035,6 +1521,22 @@ void _abort_compile(SourcePos *posp, Error err, va_list args)
 			leprintf("unreachable: %s", s);
 			break;
 
+		case ERR_ILLEGAL_ARRAY_OPERATION:
+			leprintf("illegal array operation: %s", s);
+			break;
+
+		case ERR_ILLEGAL_IN_PARALLEL_LOOP:
+			leprintf("%s not allowed in parallel loop", s);
+			break;
+
+		case ERR_NOT_AN_ARRAY:
+			leprintf("'%s' is not an array", s);
+			break;
+
+		case ERR_UNKNOWN_IDENTIFIER:
+			leprintf("unknown identifier '%s'", s);
+			break;
+
 		case ERR_STATEMENT_EXPECTED:
 			leprintf("expected statement, but found %s",
 			get_token_string(token.type));
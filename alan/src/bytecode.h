@@ -0,0 +1,120 @@
+/**
+ * @file    bytecode.h
+ * @brief   The in-memory representation of generated code for ALAN-2022,
+ *          shared by the code generator and the optimiser.
+ *
+ * A method body is an array of code entries.  An instruction entry is
+ * followed by its operands, if any, each in its own entry; a label entry marks
+ * the position of a label.  Every operand entry has the
+ * <code>CODE_OPERAND</code> bit set, so that the next instruction or label is
+ * found by skipping over entries with that bit.  A mark entry generates no
+ * code; it records a boundary between two statements at the top level of the
+ * body, at which the body may be split.  A mark entry with the
+ * <code>CODE_INTEGER</code> bit set is a line entry instead: it holds the
+ * source line of the statement whose code follows.
+ *
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @date    2022-08-03
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "codegen.h"
+#include "jvm.h"
+#include "symboltable.h"
+
+typedef enum {
+	CODE_LABEL       = 0x0001,
+	CODE_INSTRUCTION = 0x0002,
+	CODE_OPERAND     = 0x0004,
+	CODE_MARK        = 0x0008,
+	MASK_TYPE        = 0x000f,
+	CODE_INTEGER     = 0x0010,
+	CODE_ARRAY_TYPE  = 0x0020,
+	CODE_STRING      = 0x0040,
+	CODE_REFERENCE   = 0x0080,
+	MASK_DATA_TYPE   = 0x00f0,
+	CODE_ALLOCATED   = 0x0100,
+	MASK_ALLOCATION  = 0x0f00
+} CodeType;
+
+typedef struct {
+	CodeType type;
+	union {
+		JVMatype  atype;
+		Bytecode  code;
+		Label     label;
+		int       num;
+		char     *string;
+	};
+} Code;
+
+/** a stretch of code in which a local variable is live */
+typedef struct {
+	int from;  /**< the line entry at which it starts, or -1 for the start of
+	                the method                                             */
+	int to;    /**< the line entry at which it ends, or -1 for the end of the
+	                method                                                 */
+} LiveRange;
+
+/** a named local variable of a method, for its local variable table */
+typedef struct {
+	char      *name;    /**< the name of the variable                      */
+	ValType    type;    /**< its type, or TYPE_NONE for the arguments of
+	                         main                                          */
+	int        slot;    /**< its slot, or -1 if it is never used           */
+	LiveRange *spans;   /**< the stretches in which it is live, in order,
+	                         which do not overlap those of any other
+	                         variable in the slot                          */
+	int        nspans;  /**< the number of stretches                       */
+} LocalVar;
+
+typedef struct body_s Body;
+struct body_s {
+	char     *name;
+	char     *signature;
+	IDprop   *idprop;
+	Code     *code;
+	int       ip;
+	int       max_stack_depth;
+	int       variables_width;
+	LocalVar *vars;
+	int       nvars;
+	Boolean   pure;
+	int       loop;  /**< the parallel loop it runs, or -1 */
+	Body     *next;
+	Body     *prev;
+};
+
+/** whether a code entry is an instruction with the specified opcode */
+#define IS_INSTRUCTION(c, op) \
+	((c).type == CODE_INSTRUCTION && (c).code == (op))
+
+/** whether a code entry is a line entry */
+#define IS_LINE(c) ((c).type == (CODE_MARK | CODE_INTEGER))
+
+/** whether a code entry is a label operand, that is, a jump target */
+#define IS_TARGET(c) ((c).type == (CODE_LABEL | CODE_OPERAND))
+
+/** whether execution never continues after an instruction with opcode op */
+#define ENDS_BLOCK(op) \
+	((op) == JVM_ARETURN || (op) == JVM_GOTO || (op) == JVM_IRETURN || \
+	 (op) == JVM_LOOKUPSWITCH || (op) == JVM_RETURN || \
+	 (op) == JVM_TABLESWITCH)
+
+/**
+ * Determines how many values an instruction pops off the operand stack, and
+ * how many it pushes.  For method invocations, the counts are read from the
+ * method descriptor.
+ *
+ * @param[in]   c
+ *     the instruction, followed by its operands
+ * @param[out]  pop
+ *     the number of values popped
+ * @param[out]  push
+ *     the number of values pushed
+ */
+void stack_effect(Code *c, int *pop, int *push);
+
+#endif /* BYTECODE_H */
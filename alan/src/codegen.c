@@ -6,70 +6,73 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "boolean.h"
+#include "bytecode.h"
 #include "codegen.h"
 #include "error.h"
+#include "hashtable.h"
+#include "jobs.h"
+#include "optimise.h"
 #include "valtypes.h"
 
 /* --- type definitions and constants --------------------------------------- */
 
-typedef enum {
-	CODE_LABEL       = 0x0001,
-	CODE_INSTRUCTION = 0x0002,
-	CODE_OPERAND     = 0x0004,
-	MASK_TYPE        = 0x000f,
-	CODE_INTEGER     = 0x0010,
-	CODE_ARRAY_TYPE  = 0x0020,
-	CODE_STRING      = 0x0040,
-	CODE_REFERENCE   = 0x0080,
-	MASK_DATA_TYPE   = 0x00f0,
-	CODE_ALLOCATED   = 0x0100,
-	MASK_ALLOCATION  = 0x0f00
-} CodeType;
-
 typedef struct {
 	const char *instr;
 	short       pop;
 	short       push;
 } BC;
 
+/** a place in the source whose executions are counted by a profiled class */
 typedef struct {
-	CodeType type;
-	union {
-		JVMatype  atype;
-		Bytecode  code;
-		Label     label;
-		int       num;
-		char     *string;
-	};
-} Code;
-
-typedef struct body_s Body;
-struct body_s {
-	char   *name;
-	IDprop *idprop;
-	Code   *code;
-	int     ip;
-	int     max_stack_depth;
-	int     variables_width;
-	Body   *next;
-	Body   *prev;
-};
+	char *name;       /**< the function or procedure in which it lies      */
+	int   statement;  /**< the index of its statement in the function, or 0
+	                       for the entry of the function                    */
+	int   arm;        /**< the arm of the statement                         */
+	int   line;       /**< the source line                                  */
+} Probe;
+
+/** the code of an operation, which is an operand of the ones around it */
+typedef struct {
+	int     from;   /**< where its code starts                            */
+	int     to;     /**< where its code ends                              */
+	int     need;   /**< the operand stack depth it needs, once ordered   */
+	Boolean calls;  /**< whether it invokes a method                      */
+} Operand;
+
+/** the code of two operands that is to be exchanged */
+typedef struct {
+	int from;  /**< where the code of the left operand starts  */
+	int mid;   /**< where the code of the right operand starts */
+	int to;    /**< where the code of the right operand ends   */
+} Exchange;
 
 /* --- Jasmin output string literals ---------------------------------------- */
 
 char class_preamble[] =
 	".class public %s\n"
-	".super java/lang/Object\n\n"
+	".super java/lang/Object\n\n";
+
+/* only emitted for programs that read input, since setting up the scanner
+ * takes a noticeable part of the startup time of the class
+ */
+char input_fields[] =
 	".field private static final charsetName Ljava/lang/String;\n"
 	".field private static final usLocale Ljava/util/Locale;\n"
-	".field private static final scanner Ljava/util/Scanner;\n\n"
+	".field private static final scanner Ljava/util/Scanner;\n\n";
+
+char method_clinit[] =
 	".method static public <clinit>()V\n"
 	".limit stack 5\n"
 	".limit locals 1 \n"
@@ -101,6 +104,28 @@ char class_preamble[] =
 	"\treturn\n"
 	".end method\n\n";
 
+#define MEMO_SUFFIX  "$memo"
+#define KEYS_SUFFIX  "$keys"
+#define FULL_SUFFIX  "$full"
+#define IMPL_SUFFIX  "$impl"
+#define ARCHIVE_EXT  ".jsa"
+#define LAUNCHER_EXT ".sh"
+#define TRAINING_TIME 30  /* the most seconds the training run may take */
+#define TRAINING_POLL 10  /* the milliseconds between looks at the run  */
+
+/* virtual machine options for short runs: stop at the client compiler, use
+ * the simplest collector, and skip the performance data file; the training
+ * run uses the same ones, so that the archive it writes matches the runs
+ */
+#define LAUNCH_FLAGS "-XX:TieredStopAtLevel=1 -XX:+UseSerialGC -XX:-UsePerfData"
+
+char launcher_script[] =
+	"#!/bin/sh\n"
+	"# Runs %s with its class data sharing archive, if there is one.\n"
+	"dir=$(dirname \"$0\")\n"
+	"exec java -XX:SharedArchiveFile=\"$dir/%s" ARCHIVE_EXT "\" -Xshare:auto \\\n"
+	"\t" LAUNCH_FLAGS " -cp \"$dir\" %s \"$@\"\n";
+
 char method_init[] = /* "steal" via javap */
 		".method public <init>()V\n"
 		"\taload_0\n"
@@ -144,22 +169,495 @@ char method_readInt[] =
 	"\tireturn\n"
 	".end method\n\n";
 
+/* arrays, and slices of them, are read an element at a time, and written to
+ * the output stream all at once, in loops of their own; a whole array is
+ * passed on as a slice of all of its elements
+ */
+char method_read_array[] =
+	".method public static read%s(%s)V\n"
+	".limit stack 3\n"
+	".limit locals 1\n"
+	"\taload 0\n"
+	"\ticonst_0\n"
+	"\taload 0\n"
+	"\tarraylength\n"
+	"\tinvokestatic %s/read%s(%sII)V\n"
+	"\treturn\n"
+	".end method\n\n"
+	".method public static read%s(%sII)V\n"
+	".limit stack 3\n"
+	".limit locals 3\n"
+	"Loop:\n"
+	"\tiload 1\n"
+	"\tiload 2\n"
+	"\tif_icmpge Done\n"
+	"\taload 0\n"
+	"\tiload 1\n"
+	"\tinvokestatic %s/read%s()%s\n"
+	"\t%s\n"
+	"\tiinc 1 1\n"
+	"\tgoto Loop\n"
+	"Done:\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char method_write_array[] =
+	".method public static write%s(%s)V\n"
+	".limit stack 3\n"
+	".limit locals 1\n"
+	"\taload 0\n"
+	"\ticonst_0\n"
+	"\taload 0\n"
+	"\tarraylength\n"
+	"\tinvokestatic %s/write%s(%sII)V\n"
+	"\treturn\n"
+	".end method\n\n"
+	".method public static write%s(%sII)V\n"
+	".limit stack 4\n"
+	".limit locals 4\n"
+	"\tnew java/lang/StringBuilder\n"
+	"\tdup\n"
+	"\tinvokespecial java/lang/StringBuilder/<init>()V\n"
+	"\tastore 3\n"
+	"Loop:\n"
+	"\tiload 1\n"
+	"\tiload 2\n"
+	"\tif_icmpge Done\n"
+	"\taload 3\n"
+	"\tinvokevirtual java/lang/StringBuilder/length()I\n"
+	"\tifeq Append\n"
+	"\taload 3\n"
+	"\tbipush 32\n"
+	"\tinvokevirtual"
+	" java/lang/StringBuilder/append(C)Ljava/lang/StringBuilder;\n"
+	"\tpop\n"
+	"Append:\n"
+	"\taload 3\n"
+	"\taload 0\n"
+	"\tiload 1\n"
+	"\t%s\n"
+	"\tinvokevirtual"
+	" java/lang/StringBuilder/append(%s)Ljava/lang/StringBuilder;\n"
+	"\tpop\n"
+	"\tiinc 1 1\n"
+	"\tgoto Loop\n"
+	"Done:\n"
+	"\tgetstatic java/lang/System/out Ljava/io/PrintStream;\n"
+	"\taload 3\n"
+	"\tinvokevirtual java/io/PrintStream/print(Ljava/lang/Object;)V\n"
+	"\treturn\n"
+	".end method\n\n";
+
+/* a memoised function keeps its results in a cache of fixed size, created on
+ * the first call, and keyed by its argument, or by its two arguments packed
+ * into a long; the key is hashed to the one entry where it may be, and a new
+ * result takes the place of the one there, so that the cache stays bounded
+ * however many arguments the function is called with; the original method is
+ * renamed, and the wrapper takes its place
+ */
+char memo_field[] =
+	".field private static %s" MEMO_SUFFIX " [I\n"
+	".field private static %s" KEYS_SUFFIX " [J\n"
+	".field private static %s" FULL_SUFFIX " [Z\n";
+
+char memo_lookup[] =
+	".method public static %s%s\n"
+	".limit stack 6\n"
+	".limit locals %u\n"
+	"\tgetstatic %s/%s" MEMO_SUFFIX " [I\n"
+	"\tifnonnull Lookup\n"
+	"\tldc %d\n"
+	"\tnewarray int\n"
+	"\tputstatic %s/%s" MEMO_SUFFIX " [I\n"
+	"\tldc %d\n"
+	"\tnewarray long\n"
+	"\tputstatic %s/%s" KEYS_SUFFIX " [J\n"
+	"\tldc %d\n"
+	"\tnewarray boolean\n"
+	"\tputstatic %s/%s" FULL_SUFFIX " [Z\n"
+	"Lookup:\n";
+
+char memo_key_1[] =
+	"\tiload 0\n"
+	"\ti2l\n"
+	"\tlstore 1\n";
+
+char memo_key_2[] =
+	"\tiload 0\n"
+	"\ti2l\n"
+	"\tbipush 32\n"
+	"\tlshl\n"
+	"\tiload 1\n"
+	"\tinvokestatic java/lang/Integer/toUnsignedLong(I)J\n"
+	"\tlor\n"
+	"\tlstore 2\n";
+
+/* the halves of the key are folded together, and multiplied by a constant,
+ * of which the top bits give the entry
+ */
+char memo_entry[] =
+	"\tlload %u\n"
+	"\tlload %u\n"
+	"\tbipush 32\n"
+	"\tlushr\n"
+	"\tlxor\n"
+	"\tl2i\n"
+	"\tldc %d\n"
+	"\timul\n"
+	"\tbipush %d\n"
+	"\tiushr\n"
+	"\tistore %u\n";
+
+char memo_hit[] =
+	"\tgetstatic %s/%s" FULL_SUFFIX " [Z\n"
+	"\tiload %u\n"
+	"\tbaload\n"
+	"\tifeq Miss\n"
+	"\tgetstatic %s/%s" KEYS_SUFFIX " [J\n"
+	"\tiload %u\n"
+	"\tlaload\n"
+	"\tlload %u\n"
+	"\tlcmp\n"
+	"\tifne Miss\n"
+	"\tgetstatic %s/%s" MEMO_SUFFIX " [I\n"
+	"\tiload %u\n"
+	"\tiaload\n"
+	"\tireturn\n"
+	"Miss:\n";
+
+char memo_store[] =
+	"\tinvokestatic %s/%s" IMPL_SUFFIX "%s\n"
+	"\tistore %u\n"
+	"\tgetstatic %s/%s" KEYS_SUFFIX " [J\n"
+	"\tiload %u\n"
+	"\tlload %u\n"
+	"\tlastore\n"
+	"\tgetstatic %s/%s" MEMO_SUFFIX " [I\n"
+	"\tiload %u\n"
+	"\tiload %u\n"
+	"\tiastore\n"
+	"\tgetstatic %s/%s" FULL_SUFFIX " [Z\n"
+	"\tiload %u\n"
+	"\ticonst_1\n"
+	"\tbastore\n"
+	"\tiload %u\n"
+	"\tireturn\n"
+	".end method\n\n";
+
+/* a profiled class counts the executions of every function, and of every arm
+ * of its if and while statements, in an array of longs; main runs in a
+ * wrapper, which writes the counts, one per line after their places in the
+ * source, when the program returns or fails
+ */
+#define PROF_EXT     ".prof"
+#define PROF_CHUNK   256  /* the most places described by one string */
+#define HOT_RATIO    100  /* how much more the hottest place may run than a
+                             hot one */
+
+char prof_field[] =
+	".field private static prof$counts [J\n";
+
+/* the iterations of a parallel loop may count at the same time */
+char method_prof_hit[] =
+	".method public static synchronized prof$hit(I)V\n"
+	".limit stack 6\n"
+	".limit locals 1\n"
+	"\tgetstatic %s/prof$counts [J\n"
+	"\tiload 0\n"
+	"\tdup2\n"
+	"\tlaload\n"
+	"\tlconst_1\n"
+	"\tladd\n"
+	"\tlastore\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char method_prof_print[] =
+	".method public static prof$print"
+	"(Ljava/io/PrintStream;Ljava/lang/String;I)V\n"
+	".limit stack 5\n"
+	".limit locals 5\n"
+	"\taload 1\n"
+	"\tldc	\";\"\n"
+	"\tinvokevirtual"
+	" java/lang/String/split(Ljava/lang/String;)[Ljava/lang/String;\n"
+	"\tastore 3\n"
+	"\ticonst_0\n"
+	"\tistore 4\n"
+	"Next:\n"
+	"\tiload 4\n"
+	"\taload 3\n"
+	"\tarraylength\n"
+	"\tif_icmpge Done\n"
+	"\taload 0\n"
+	"\taload 3\n"
+	"\tiload 4\n"
+	"\taaload\n"
+	"\tinvokevirtual java/io/PrintStream/print(Ljava/lang/String;)V\n"
+	"\taload 0\n"
+	"\tgetstatic %s/prof$counts [J\n"
+	"\tiload 2\n"
+	"\tiload 4\n"
+	"\tiadd\n"
+	"\tlaload\n"
+	"\tinvokevirtual java/io/PrintStream/println(J)V\n"
+	"\tiinc 4 1\n"
+	"\tgoto Next\n"
+	"Done:\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char method_prof_report_head[] =
+	".method public static prof$report()V\n"
+	".limit stack 4\n"
+	".limit locals 1\n"
+	"\tnew	java/io/PrintStream\n"
+	"\tdup\n"
+	"\tldc	\"%s" PROF_EXT "\"\n"
+	"\tinvokespecial java/io/PrintStream/<init>(Ljava/lang/String;)V\n"
+	"\tastore 0\n";
+
+char method_prof_report_tail[] =
+	"\taload 0\n"
+	"\tinvokevirtual java/io/PrintStream/close()V\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char method_prof_main[] =
+	".method public static main([Ljava/lang/String;)V\n"
+	".limit stack 2\n"
+	".limit locals 1\n"
+	"\tldc %d\n"
+	"\tnewarray long\n"
+	"\tputstatic %s/prof$counts [J\n"
+	"Start:\n"
+	"\taload 0\n"
+	"\tinvokestatic %s/main" IMPL_SUFFIX "([Ljava/lang/String;)V\n"
+	"End:\n"
+	"\tinvokestatic %s/prof$report()V\n"
+	"\treturn\n"
+	"Failed:\n"
+	"\tinvokestatic %s/prof$report()V\n"
+	"\tathrow\n"
+	".catch all from Start to End using Failed\n"
+	".end method\n\n";
+
+/* a parallel loop runs in a method of its own, which is passed its bounds,
+ * and the variables the loop body reads, followed by a flag; if the flag is
+ * not set, the method hands its arguments to par$run, in an integer array,
+ * an array of integer arrays, and an array of boolean arrays, which splits
+ * the range among the processors, and submits an instance of the class for
+ * each part to the common fork/join pool; each instance runs the method again
+ * for its part, with the flag set, through run
+ */
+char par_fields[] =
+	".implements java/lang/Runnable\n"
+	".field private par$loop I\n"
+	".field private par$ints [I\n"
+	".field private par$arrays [[I\n"
+	".field private par$flags [[Z\n\n";
+
+char method_par_run_head[] =
+	".method public run()V\n"
+	".limit stack %d\n"
+	".limit locals 1\n"
+	"\taload_0\n"
+	"\tgetfield %s/par$loop I\n"
+	"\ttableswitch 0 %d\n";
+
+char method_par_run_tail[] =
+	"Done:\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char method_par_split[] =
+	".method public static par$run(I[I[[I[[Z)V\n"
+	".limit stack 8\n"
+	".limit locals 11\n"
+	"\tinvokestatic java/lang/Runtime/getRuntime()Ljava/lang/Runtime;\n"
+	"\tinvokevirtual java/lang/Runtime/availableProcessors()I\n"
+	"\tistore 4\n"
+	"\taload 1\n"
+	"\ticonst_1\n"
+	"\tiaload\n"
+	"\ti2l\n"
+	"\taload 1\n"
+	"\ticonst_0\n"
+	"\tiaload\n"
+	"\ti2l\n"
+	"\tlsub\n"
+	"\tlconst_1\n"
+	"\tladd\n"
+	"\tlstore 5\n"
+	"\tlload 5\n"
+	"\tiload 4\n"
+	"\ti2l\n"
+	"\tlcmp\n"
+	"\tifge Split\n"
+	"\tlload 5\n"
+	"\tl2i\n"
+	"\tistore 4\n"
+	"Split:\n"
+	"\tiload 4\n"
+	"\tanewarray java/util/concurrent/ForkJoinTask\n"
+	"\tastore 7\n"
+	"\ticonst_0\n"
+	"\tistore 8\n"
+	"Fork:\n"
+	"\tiload 8\n"
+	"\tiload 4\n"
+	"\tif_icmpge Join\n"
+	"\tnew\t%s\n"
+	"\tdup\n"
+	"\tinvokespecial %s/<init>()V\n"
+	"\tastore 9\n"
+	"\taload 9\n"
+	"\tiload 0\n"
+	"\tputfield %s/par$loop I\n"
+	"\taload 9\n"
+	"\taload 2\n"
+	"\tputfield %s/par$arrays [[I\n"
+	"\taload 9\n"
+	"\taload 3\n"
+	"\tputfield %s/par$flags [[Z\n"
+	"\taload 1\n"
+	"\taload 1\n"
+	"\tarraylength\n"
+	"\tinvokestatic java/util/Arrays/copyOf([II)[I\n"
+	"\tastore 10\n"
+	"\taload 10\n"
+	"\ticonst_0\n"
+	"\taload 1\n"
+	"\ticonst_0\n"
+	"\tiaload\n"
+	"\ti2l\n"
+	"\tlload 5\n"
+	"\tiload 8\n"
+	"\ti2l\n"
+	"\tlmul\n"
+	"\tiload 4\n"
+	"\ti2l\n"
+	"\tldiv\n"
+	"\tladd\n"
+	"\tl2i\n"
+	"\tiastore\n"
+	"\taload 10\n"
+	"\ticonst_1\n"
+	"\taload 1\n"
+	"\ticonst_0\n"
+	"\tiaload\n"
+	"\ti2l\n"
+	"\tlload 5\n"
+	"\tiload 8\n"
+	"\ticonst_1\n"
+	"\tiadd\n"
+	"\ti2l\n"
+	"\tlmul\n"
+	"\tiload 4\n"
+	"\ti2l\n"
+	"\tldiv\n"
+	"\tladd\n"
+	"\tlconst_1\n"
+	"\tlsub\n"
+	"\tl2i\n"
+	"\tiastore\n"
+	"\taload 9\n"
+	"\taload 10\n"
+	"\tputfield %s/par$ints [I\n"
+	"\taload 7\n"
+	"\tiload 8\n"
+	"\tinvokestatic java/util/concurrent/ForkJoinPool/commonPool()"
+	"Ljava/util/concurrent/ForkJoinPool;\n"
+	"\taload 9\n"
+	"\tinvokevirtual java/util/concurrent/ForkJoinPool/submit"
+	"(Ljava/lang/Runnable;)Ljava/util/concurrent/ForkJoinTask;\n"
+	"\taastore\n"
+	"\tiinc 8 1\n"
+	"\tgoto Fork\n"
+	"Join:\n"
+	"\ticonst_0\n"
+	"\tistore 8\n"
+	"Wait:\n"
+	"\tiload 8\n"
+	"\tiload 4\n"
+	"\tif_icmpge Done\n"
+	"\taload 7\n"
+	"\tiload 8\n"
+	"\taaload\n"
+	"\tinvokevirtual"
+	" java/util/concurrent/ForkJoinTask/join()Ljava/lang/Object;\n"
+	"\tpop\n"
+	"\tiinc 8 1\n"
+	"\tgoto Wait\n"
+	"Done:\n"
+	"\treturn\n"
+	".end method\n\n";
+
+/* copies a slice of an array into another of the same length, as
+ * System.arraycopy does, which only takes the length of one of them
+ */
+char method_arr_copy[] =
+	".method private static arr$copy(Ljava/lang/Object;II"
+	"Ljava/lang/Object;II)V\n"
+	".limit stack 6\n"
+	".limit locals 6\n"
+	"\tiload_2\n"
+	"\tiload_1\n"
+	"\tisub\n"
+	"\tiload 5\n"
+	"\tiload 4\n"
+	"\tisub\n"
+	"\tif_icmpeq Copy\n"
+	"\tnew java/lang/IllegalArgumentException\n"
+	"\tdup\n"
+	"\tldc \"slices of different lengths\"\n"
+	"\tinvokespecial"
+	" java/lang/IllegalArgumentException/<init>(Ljava/lang/String;)V\n"
+	"\tathrow\n"
+	"Copy:\n"
+	"\taload_3\n"
+	"\tiload 4\n"
+	"\taload_0\n"
+	"\tiload_1\n"
+	"\tiload_2\n"
+	"\tiload_1\n"
+	"\tisub\n"
+	"\tinvokestatic java/lang/System/arraycopy"
+	"(Ljava/lang/Object;ILjava/lang/Object;II)V\n"
+	"\treturn\n"
+	".end method\n\n";
+
+char  ref_equals_boolean[] = "java/util/Arrays/equals([ZII[ZII)Z";
+char  ref_equals_integer[] = "java/util/Arrays/equals([III[III)Z";
+char  ref_fill_boolean[]   = "java/util/Arrays/fill([ZIIZ)V";
+char  ref_fill_integer[]   = "java/util/Arrays/fill([IIII)V";
 char  ref_print_boolean[] = "java/io/PrintStream/print(Z)V";
 char  ref_print_integer[] = "java/io/PrintStream/print(I)V";
 char  ref_print_stream[]  = "java/lang/System/out Ljava/io/PrintStream;";
 char  ref_print_string[]  = "java/io/PrintStream/print(Ljava/lang/String;)V";
 char *ref_read_boolean;   /* must be set in set_class_name */
 char *ref_read_integer;   /* must be set in set_class_name */
+char *ref_prof_hit;       /* must be set in set_class_name */
+char *ref_par_run;        /* must be set in set_class_name */
+char *ref_arr_copy;       /* must be set in set_class_name */
 
 #define REF_READ_BOOLEAN "/readBoolean()Z"
 #define REF_READ_INTEGER "/readInt()I"
+#define REF_PROF_HIT     "/prof$hit(I)V"
+#define REF_PAR_RUN      "/par$run(I[I[[I[[Z)V"
+#define REF_ARR_COPY     "/arr$copy(Ljava/lang/Object;IILjava/lang/Object;II)V"
 
 /* --- global static variables ---------------------------------------------- */
 
 static BC instruction_set[] = {
+	{ "aaload",        2, 1 },
+	{ "aastore",       3, 0 },
 	{ "aload",         0, 1 },
+	{ "anewarray",     1, 1 },
 	{ "areturn",       1, 0 },
 	{ "astore",        1, 0 },
+	{ "baload",        2, 1 },
+	{ "bastore",       3, 0 },
 	{ "getstatic",     0, 1 },
 	{ "goto",          0, 0 },
 	{ "iadd",          2, 1 },
@@ -168,27 +666,33 @@ static BC instruction_set[] = {
 	{ "iastore",       3, 0 },
 	{ "idiv",          2, 1 },
 	{ "ifeq",          1, 0 },
+	{ "ifne",          1, 0 },
 	{ "if_icmpeq",     2, 0 },
 	{ "if_icmpge",     2, 0 },
 	{ "if_icmpgt",     2, 0 },
 	{ "if_icmple",     2, 0 },
 	{ "if_icmplt",     2, 0 },
 	{ "if_icmpne",     2, 0 },
+	{ "iinc",          0, 0 },
 	{ "iload",         0, 1 },
 	{ "imul",          2, 1 },
 	{ "ineg",          1, 1 },
 	{ "invokestatic",  0, 1 },
 	{ "invokevirtual", 0, 0 },
 	{ "ior",           2, 1 },
+	{ "ishr",          2, 1 },
 	{ "istore",        1, 0 },
 	{ "isub",          2, 1 },
 	{ "irem",          2, 1 },
 	{ "ireturn",       1, 0 },
 	{ "ixor",          2, 1 },
 	{ "ldc",           0, 1 },
+	{ "lookupswitch",  1, 0 },
 	{ "newarray",      1, 1 },
+	{ "pop",           1, 0 },
 	{ "return",        0, 0 },
-	{ "swap",          2, 2 }
+	{ "swap",          2, 2 },
+	{ "tableswitch",   1, 0 }
 };
 
 static const char *java_types[] = {
@@ -197,7 +701,13 @@ static const char *java_types[] = {
 
 #define NBYTECODES   (sizeof(instruction_set) / sizeof(BC))
 #define INITIAL_SIZE 1024
+#define TEST_LENGTH  16  /* code entries in an "x = c" test and its jump */
+#define SWITCH_MIN   3   /* the minimum number of tests to make a switch */
+#define UNROLL_MAX   48  /* the most code entries in a loop body to unroll  */
 #define JASM_EXT     ".jasmin"
+#define MEMO_ARGS    2   /* the most arguments of a memoised function */
+#define MEMO_BITS    12  /* the entries of a memo cache, as a power of two */
+#define MEMO_HASH    -1640531527  /* 2^32 over the golden ratio, as an int */
 
 static char   *class_name;    /**< the class name                             */
 static char   *function_name; /**< the name of current function               */
@@ -207,19 +717,85 @@ static int     ip;            /**< the instruction pointer                    */
 static Body   *bodies;        /**< list of function bodies                    */
 static Code   *code;          /**< the generated code                         */
 static IDprop *idprop;        /**< id properties of the current function      */
+static int     unroll_factor; /**< the number of loop bodies per iteration    */
+static Boolean reads_input;   /**< whether any input is read                  */
+static Boolean copies_slices; /**< whether any slice of an array is copied    */
+static Boolean reads_arrays;  /**< whether any array is read as a whole       */
+static Boolean writes_arrays; /**< whether any array is written as a whole    */
+static Boolean memoise;       /**< whether to memoise pure functions          */
+static Boolean list_removed;  /**< whether to report unreachable functions    */
+static Boolean profile;       /**< whether to count executions                */
+static Boolean streaming;     /**< whether to write methods as they close     */
+static Boolean parallel;      /**< whether parallel loops are compiled        */
+static FILE   *stream_file;   /**< the code file, while methods are streamed  */
+static Probe  *probes;        /**< the places whose executions are counted    */
+static int     nprobes;       /**< the number of counted places               */
+static int     probes_size;   /**< the allocated number of counted places     */
+static HashTab *counts;       /**< the counts of a previous profiled run      */
+static HashTab *purity;       /**< whether each function is pure, by name     */
+static long    hottest;       /**< the greatest of those counts               */
+static LocalVar *vars;        /**< the named variables of current function    */
+static int     nvars;         /**< the number of named variables              */
+static int     vars_size;     /**< the allocated number of named variables    */
+static Body   *kernels;       /**< the parallel loops of current function     */
+static int     nloops;        /**< the number of parallel loops so far        */
+static Operand *operands;     /**< the outermost operations generated so far  */
+static int     noperands;     /**< the number of those operations             */
+static int     operands_size; /**< the allocated number of operations         */
+static Exchange *exchanges;   /**< the operands yet to be exchanged           */
+static int     nexchanges;    /**< the number of exchanges                    */
+static int     exchanges_size; /**< the allocated number of exchanges         */
 
 int stack_depth, max_stack_depth;
 
 /* --- function prototypes -------------------------------------------------- */
 
 static void ensure_space(int num_instr);
+static void gen_reference(Bytecode opcode, char *ref, CodeType allocated);
+static char *class_suffixed(const char *suffix);
+static char *array_reference(const char *verb, ValType type);
+static Boolean refers_to(const char *ref, const char *method);
+static Boolean accesses_local(Code *c);
+static ValType variable_type(int slot);
+static LiveRange *whole_method(void);
 static void adjust_stack(BC *instr);
+static const char *element_descriptor(ValType type);
+static Boolean fold_iinc(int offset);
+static Boolean match_test(int at, Bytecode cmp, unsigned int *offset,
+		int *value, Label *target);
+static Boolean match_chain(int ntests, int *starts, int *ends, int *keys,
+		unsigned int *offset, Label *dflt);
+static void copy_renamed(Code *dst, Code *src, int n);
+static void replace_code(int from, int to, Code *repl, int nrepl);
+static void rotate_code(int from, int mid, int to);
+static int operand_need(int from, int to, Boolean *calls);
+static int stack_need(Code *c, int from, int to);
+static void remove_dead_functions(void);
+static void release_body(Body *b);
+static void strip_body(Body *b);
+static void note_library_calls(Body *b);
+static void stream_method(Body *b);
+static void discard_stream(void);
+static void finish_body(void *arg);
+static void measure_stack(void *arg);
+static void gen_probe(int statement, int arm);
+static long frequency(const char *name, int statement, int arm);
+static Boolean hot(long count);
+static char *place_key(const char *name, int statement, int arm);
+static unsigned int name_hash(void *key, unsigned int size);
+static int name_cmp(void *val1, void *val2);
 
 /* --- code generation interface -------------------------------------------- */
 
 void init_code_generation(void)
 {
 	bodies = NULL;
+	if ((purity = ht_init(0.75f, name_hash, name_cmp)) == NULL) {
+		eprintf("Purity table could not be initialised");
+	}
+	reads_input = FALSE;
+	copies_slices = reads_arrays = writes_arrays = FALSE;
+	nloops = 0;
 }
 
 void init_subroutine_codegen(const char *name, IDprop *p)
@@ -230,61 +806,288 @@ void init_subroutine_codegen(const char *name, IDprop *p)
 	code_size = INITIAL_SIZE;
 	function_name = estrdup(name);
 	idprop = p;
+	vars = NULL;
+	nvars = vars_size = 0;
+	kernels = NULL;
+
+	/* the argument array of main is its only parameter */
+	if (strcmp(name, "main") == 0) {
+		declare_variable("args", TYPE_NONE, 0);
+	}
+
+	if (profile) {
+		gen_probe(0, 0);
+	}
+}
+
+void make_launcher(void)
+{
+	FILE *script;
+	char *script_name, *archive, *option, *flags, *flag, **args;
+	int status, fd, waited, nargs;
+	pid_t pid, ended;
+	struct timespec poll = { 0, TRAINING_POLL * 1000000L };
+
+	/* the script that runs the class with the archive and flags */
+	script_name = class_suffixed(LAUNCHER_EXT);
+	if ((script = fopen(script_name, "w")) == NULL) {
+		eprintf("Could not open launcher file:");
+	}
+	fprintf(script, launcher_script, class_name, class_name, class_name);
+	fclose(script);
+	if (chmod(script_name, 0755) < 0) {
+		eprintf("Could not make launcher executable:");
+	}
+
+	/* a training run, with no input and discarded output, records the loaded
+	 * classes in the archive when the virtual machine exits
+	 */
+	archive = class_suffixed(ARCHIVE_EXT);
+	option = emalloc(strlen(archive) + sizeof("-XX:ArchiveClassesAtExit="));
+	strcpy(option, "-XX:ArchiveClassesAtExit=");
+	strcat(option, archive);
+	unlink(archive);
+
+	/* the launch flags, one argument each, between the archive and the class
+	 * path
+	 */
+	flags = estrdup(LAUNCH_FLAGS);
+	args = emalloc((strlen(flags) / 2 + 7) * sizeof(char *));
+	nargs = 0;
+	args[nargs++] = "java";
+	args[nargs++] = option;
+	for (flag = strtok(flags, " "); flag != NULL; flag = strtok(NULL, " ")) {
+		args[nargs++] = flag;
+	}
+	args[nargs++] = "-cp";
+	args[nargs++] = ".";
+	args[nargs++] = class_name;
+	args[nargs] = NULL;
+
+	if ((pid = fork()) < 0) {
+		eprintf("Could not fork a new process for the training run");
+	} else if (pid == 0) {
+		if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+			dup2(fd, STDIN_FILENO);
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		if (execvp("java", args) < 0) {
+			_exit(EXIT_FAILURE);
+		}
+	}
+
+	/* the program may fail without input, but the archive is still written;
+	 * a run that does not end in time is stopped, and without an archive, the
+	 * launcher runs the class without sharing
+	 */
+	for (waited = 0; (ended = waitpid(pid, &status, WNOHANG)) == 0
+			&& waited < TRAINING_TIME * 1000; waited += TRAINING_POLL) {
+		nanosleep(&poll, NULL);
+	}
+	if (ended == 0) {
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		unlink(archive);
+		weprintf("training run of %s stopped after %d seconds; no class data "
+				"sharing archive", class_name, TRAINING_TIME);
+	} else if (ended < 0) {
+		eprintf("Error waiting for the training run");
+	} else if (access(archive, R_OK) < 0) {
+		weprintf("no class data sharing archive for %s", class_name);
+	}
+
+	free(args);
+	free(flags);
+	free(option);
+	free(archive);
+	free(script_name);
 }
 
 void close_subroutine_codegen(int varwidth)
 {
-	Body *body;
+	Body *body, *b;
+	Boolean *pure;
 
 	body = emalloc(sizeof(Body));
 
 	/* populate new body */
 	body->name = function_name;
+	body->signature = NULL;
 	body->idprop = idprop;
 	body->code = code;
 	body->ip = ip;
-	body->max_stack_depth = max_stack_depth;
 	body->variables_width = varwidth;
+	body->vars = vars;
+	body->nvars = nvars;
+	body->pure = FALSE;
+	body->loop = -1;
 	body->next = NULL;
 	body->prev = NULL;
 
+	/* move statements out of a method too large for the JIT compiler, and
+	 * follow the new methods with those of the parallel loops
+	 */
+	body->next = split_method(body, class_name);
+	for (b = body; b->next != NULL; b = b->next)
+		;
+	b->next = kernels;
+	if (kernels != NULL) {
+		kernels->prev = b;
+	}
+
 	/* link into list */
 
-	Body *n, *p;
+	Body *n;
 	n = bodies;
-	p = NULL;
 
 	if (bodies != NULL) {
 		while (n->next != NULL) {
-			p = n;
-			p = p->next;
+			n = n->next;
 		}
-		n->prev = p;
+		body->prev = n;
 		n->next = body;
 	}
 	if (bodies == NULL) {
 		bodies = body;
 	}
+
+	/* the methods compiled before call none of the new ones, so that their
+	 * purity is settled; the rest of the work on the new methods is theirs
+	 * alone, and is left to the jobs
+	 */
+	find_pure_functions(bodies, body, class_name);
+	pure = emalloc(sizeof(Boolean));
+	*pure = body->pure;
+	if (ht_insert(purity, estrdup(body->name), pure) != EXIT_SUCCESS) {
+		eprintf("Purity of '%s' could not be recorded", body->name);
+	}
+	for (b = body; b != NULL; b = b->next) {
+		add_job(finish_body, b);
+	}
+
+	/* a streamed method is written out as soon as it is finished, and only
+	 * what later methods need to know about it is kept
+	 */
+	if (streaming) {
+		wait_for_jobs();
+		for (b = body; b != NULL; b = b->next) {
+			stream_method(b);
+		}
+	}
 }
 
-void set_class_name(char *cname)
+void declare_variable(const char *name, ValType type, unsigned int offset)
 {
-	size_t class_name_len;
+	if (nvars == vars_size) {
+		vars_size = vars_size ? 2 * vars_size : 8;
+		vars = erealloc(vars, sizeof(LocalVar) * vars_size);
+	}
+	vars[nvars].name = estrdup(name);
+	vars[nvars].type = type;
+	vars[nvars].spans = whole_method();
+	vars[nvars].nspans = 1;
+	vars[nvars++].slot = (int) offset;
+}
 
-	class_name = estrdup(cname);
-	class_name_len = strlen(class_name);
+void read_profile(const char *path)
+{
+	FILE *file;
+	char *line = NULL, *name;
+	size_t size = 0;
+	int statement, arm, n = 0;
+	long count, *value;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		eprintf("Could not open profile '%s':", path);
+	}
+	if ((counts = ht_init(0.75f, name_hash, name_cmp)) == NULL) {
+		eprintf("Profile table could not be initialised");
+	}
+	hottest = 0;
+
+	/* each line holds a function, a statement, an arm, a line and a count */
+	while (getline(&line, &size, file) != -1) {
+		n++;
+		name = emalloc(strlen(line) + 1);
+		if (sscanf(line, "%s %d %d %*d %ld", name, &statement, &arm, &count)
+				!= 4 || count < 0) {
+			eprintf("malformed entry in line %d of profile '%s'", n, path);
+		}
+		value = emalloc(sizeof(long));
+		*value = count;
+		if (ht_insert(counts, place_key(name, statement, arm), value)
+				!= EXIT_SUCCESS) {
+			eprintf("duplicate entry in line %d of profile '%s'", n, path);
+		}
+		if (count > hottest) {
+			hottest = count;
+		}
+		free(name);
+	}
+
+	free(line);
+	fclose(file);
+}
+
+void set_list_removed(Boolean enable)
+{
+	list_removed = enable;
+}
+
+void set_memoisation(Boolean enable)
+{
+	memoise = enable;
+}
+
+void set_streaming(Boolean enable)
+{
+	streaming = enable;
+}
 
-	jasm_name = emalloc(class_name_len + sizeof(JASM_EXT));
-	strcpy(jasm_name, class_name);
-	strncat(jasm_name, JASM_EXT, sizeof(JASM_EXT));
+void set_parallel_code(Boolean enable)
+{
+	parallel = enable;
+}
+
+void set_profiling(Boolean enable)
+{
+	profile = enable;
+}
 
-	ref_read_boolean = emalloc(class_name_len + sizeof(REF_READ_BOOLEAN));
-	strcpy(ref_read_boolean, class_name);
-	strncat(ref_read_boolean, REF_READ_BOOLEAN, sizeof(REF_READ_BOOLEAN));
+void set_unroll_factor(int factor)
+{
+	unroll_factor = factor;
+}
 
-	ref_read_integer = emalloc(class_name_len + sizeof(REF_READ_INTEGER));
-	strcpy(ref_read_integer, class_name);
-	strncat(ref_read_integer, REF_READ_INTEGER, sizeof(REF_READ_INTEGER));
+void set_class_name(char *cname)
+{
+	class_name = estrdup(cname);
+	jasm_name = class_suffixed(JASM_EXT);
+	ref_read_boolean = class_suffixed(REF_READ_BOOLEAN);
+	ref_read_integer = class_suffixed(REF_READ_INTEGER);
+	ref_prof_hit = class_suffixed(REF_PROF_HIT);
+	ref_par_run = class_suffixed(REF_PAR_RUN);
+	ref_arr_copy = class_suffixed(REF_ARR_COPY);
+
+	/* the fields must come before the methods; those that may be needed are
+	 * declared up front, since it is not known yet which are
+	 */
+	if (streaming) {
+		if ((stream_file = fopen(jasm_name, "w")) == NULL) {
+			eprintf("Could not open code file:");
+		}
+		atexit(discard_stream);
+		fprintf(stream_file, class_preamble, class_name);
+		if (parallel) {
+			fputs(par_fields, stream_file);
+		}
+		fputs(input_fields, stream_file);
+		if (profile) {
+			fputs(prof_field, stream_file);
+		}
+		fputs(method_init, stream_file);
+	}
 }
 
 void assemble(const char *jasmin_path)
@@ -324,6 +1127,10 @@ void gen_1(Bytecode opcode)
 
 void gen_2(Bytecode opcode, int operand)
 {
+	if (opcode == JVM_ISTORE && fold_iinc(operand)) {
+		return;
+	}
+
 	ensure_space(2);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -348,21 +1155,21 @@ void gen_call(char *fname, IDprop *idprop)
 	/* 6 + 2 * idprop->nparams:
 	 *  -- 1 for '\0'
 	 *  -- 2 for '(' and ')' of parameter list
-	 *  -- 1 for '.' separating class from method name
+	 *  -- 1 for '/' separating class from method name
 	 *  -- 2 for return type, including possibility of array type
 	 * the multiplier of 2 includes the possibilities of array types
 	 */
 	fpath = emalloc(strlen(class_name) + strlen(fname) +
 			(6 + 2 * idprop->nparams) * sizeof(char));
 	strcpy(fpath, class_name);
-	strcat(fpath, ".");
+	strcat(fpath, "/");
 	strcat(fpath, fname);
 	strcat(fpath, "(");
 	for (i = 0; i < idprop->nparams; i++) {
 		if (IS_ARRAY_TYPE(idprop->params[i])) {
 			strcat(fpath, "[");
 		}
-		strcat(fpath, "I");
+		strcat(fpath, element_descriptor(idprop->params[i]));
 	}
 	strcat(fpath, ")");
 	if (IS_ARRAY_TYPE(idprop->type)) {
@@ -371,7 +1178,7 @@ void gen_call(char *fname, IDprop *idprop)
 	if (idprop->type == TYPE_CALLABLE) {
 		strcat(fpath, "V");
 	} else {
-		strcat(fpath, "I");
+		strcat(fpath, element_descriptor(idprop->type));
 	}
 
 	code[ip].type = CODE_OPERAND | CODE_REFERENCE | CODE_ALLOCATED;
@@ -397,6 +1204,28 @@ void gen_cmp(Bytecode opcode)
 	gen_label(l2);
 }
 
+void gen_copy(void)
+{
+	copies_slices = TRUE;
+	gen_reference(JVM_INVOKESTATIC, ref_arr_copy, 0);
+}
+
+void gen_equals(ValType type, Boolean equal)
+{
+	gen_reference(JVM_INVOKESTATIC,
+			(IS_BOOLEAN_TYPE(type) ? ref_equals_boolean : ref_equals_integer), 0);
+	if (!equal) {
+		gen_2(JVM_LDC, TRUE);
+		gen_1(JVM_IXOR);
+	}
+}
+
+void gen_fill(ValType type)
+{
+	gen_reference(JVM_INVOKESTATIC,
+			(IS_BOOLEAN_TYPE(type) ? ref_fill_boolean : ref_fill_integer), 0);
+}
+
 void gen_label(Label label)
 {
 	ensure_space(1);
@@ -405,6 +1234,13 @@ void gen_label(Label label)
 	code[ip++].label = label;
 }
 
+void gen_arm(int statement, int arm)
+{
+	if (profile) {
+		gen_probe(statement, arm);
+	}
+}
+
 void gen_2_label(Bytecode opcode, Label label)
 {
 	ensure_space(2);
@@ -418,6 +1254,27 @@ void gen_2_label(Bytecode opcode, Label label)
 
 }
 
+void gen_mark(void)
+{
+	ensure_space(1);
+
+	code[ip++].type = CODE_MARK;
+}
+
+void gen_line(int line)
+{
+	/* a statement that generates no code gives way to the next one */
+	if (ip > 0 && IS_LINE(code[ip - 1])) {
+		code[ip - 1].num = line;
+		return;
+	}
+
+	ensure_space(1);
+
+	code[ip].type = CODE_MARK | CODE_INTEGER;
+	code[ip++].num = line;
+}
+
 void gen_newarray(JVMatype atype)
 {
 	ensure_space(2);
@@ -431,8 +1288,211 @@ void gen_newarray(JVMatype atype)
 	adjust_stack(&instruction_set[JVM_NEWARRAY]);
 }
 
+void gen_parallel(int body, unsigned int offset)
+{
+	Body *kernel, *k;
+	Code *loop, *caller;
+	ValType *params, type;
+	int n = ip - body, caller_ip, caller_size, width, nparams, flag, nlocals,
+		i, c, j, v, count[3] = { 0 }, *kind, *param, *slot;
+	char *signature, *ref;
+	Label next, done;
+
+	/* the slots the body uses, and the kind of value in each: a scalar, an
+	 * integer array, or a boolean array
+	 */
+	width = offset + 1;
+	for (i = body; i < ip; i++) {
+		if (accesses_local(&code[i]) && code[i + 1].num >= width) {
+			width = code[i + 1].num + 1;
+		}
+	}
+	kind = emalloc(width * sizeof(int));
+	param = emalloc(width * sizeof(int));
+	for (v = 0; v < width; v++) {
+		kind[v] = param[v] = -1;
+	}
+	for (i = body; i < ip; i++) {
+		if (accesses_local(&code[i])) {
+			v = code[++i].num;
+			type = variable_type(v);
+			kind[v] = (code[i - 1].code != JVM_ALOAD
+					&& code[i - 1].code != JVM_ASTORE ? 0
+					: IS_BOOLEAN_TYPE(type) ? 2 : 1);
+		}
+	}
+
+	/* the loop variable runs from the lower bound in its place; the other
+	 * variables follow the bounds, scalars first, then arrays, then the flag
+	 */
+	slot = emalloc((width + 3) * sizeof(int));
+	params = emalloc((width + 3) * sizeof(ValType));
+	param[offset] = 0;
+	params[0] = params[1] = TYPE_INTEGER;
+	nparams = 2;
+	for (c = 0; c < 3; c++) {
+		for (v = 0; v < width; v++) {
+			if (kind[v] == c && (unsigned int) v != offset) {
+				slot[nparams] = v;
+				params[nparams] = (c == 0 ? TYPE_INTEGER
+						: TYPE_ARRAY | (c == 2 ? TYPE_BOOLEAN : TYPE_INTEGER));
+				param[v] = nparams++;
+				count[c]++;
+			}
+		}
+	}
+	flag = nparams;
+	params[nparams++] = TYPE_INTEGER;
+
+	nlocals = flag + 4;
+
+	signature = emalloc(2 * nparams + 4);
+	strcpy(signature, "(II");
+	for (i = 2; i < flag; i++) {
+		strcat(signature, (params[i] == TYPE_INTEGER ? "I"
+					: IS_BOOLEAN_TYPE(params[i]) ? "[Z" : "[I"));
+	}
+	strcat(signature, "I)V");
+
+	/* the method is generated like any other, into a fresh code array */
+	loop = emalloc(n * sizeof(Code));
+	memcpy(loop, &code[body], n * sizeof(Code));
+	caller = code;
+	caller_ip = body;
+	caller_size = code_size;
+	code = emalloc(INITIAL_SIZE * sizeof(Code));
+	code_size = INITIAL_SIZE;
+	ip = 0;
+	next = get_label();
+	done = get_label();
+
+	/* unless it runs a part already, pack the arguments, and hand them over
+	 */
+	gen_2(JVM_ILOAD, 0);
+	gen_2(JVM_ILOAD, 1);
+	gen_2_label(JVM_IF_ICMPGT, done);
+	gen_2(JVM_ILOAD, flag);
+	gen_2_label(JVM_IFNE, next);
+	gen_2(JVM_LDC, 2 + count[0]);
+	gen_newarray(T_INT);
+	gen_2(JVM_ASTORE, flag + 1);
+	gen_2(JVM_LDC, count[1]);
+	gen_reference(JVM_ANEWARRAY, "[I", 0);
+	gen_2(JVM_ASTORE, flag + 2);
+	gen_2(JVM_LDC, count[2]);
+	gen_reference(JVM_ANEWARRAY, "[Z", 0);
+	gen_2(JVM_ASTORE, flag + 3);
+	for (i = 0, j = 0, c = 0; i < flag; i++, j++) {
+		while (c < 2 && j == (c == 0 ? 2 + count[0] : count[1])) {
+			c++;
+			j = 0;
+		}
+		gen_2(JVM_ALOAD, flag + 1 + c);
+		gen_2(JVM_LDC, j);
+		gen_2((c == 0 ? JVM_ILOAD : JVM_ALOAD), i);
+		gen_1(c == 0 ? JVM_IASTORE : JVM_AASTORE);
+	}
+	gen_2(JVM_LDC, nloops);
+	for (c = 1; c <= 3; c++) {
+		gen_2(JVM_ALOAD, flag + c);
+	}
+	gen_reference(JVM_INVOKESTATIC, ref_par_run, 0);
+	gen_1(JVM_RETURN);
+
+	/* the body, with its variables in their new slots, for every index */
+	gen_label(next);
+	ensure_space(n);
+	for (i = 0; i < n; i++) {
+		code[ip++] = loop[i];
+		if (accesses_local(&loop[i])) {
+			v = loop[++i].num;
+			code[ip] = loop[i];
+			code[ip++].num = param[v];
+		}
+	}
+	gen_2(JVM_ILOAD, 0);
+	gen_2(JVM_ILOAD, 1);
+	gen_2_label(JVM_IF_ICMPEQ, done);
+	ensure_space(3);
+	code[ip].type = CODE_INSTRUCTION;
+	code[ip++].code = JVM_IINC;
+	code[ip].type = CODE_OPERAND | CODE_INTEGER;
+	code[ip++].num = 0;
+	code[ip].type = CODE_OPERAND | CODE_INTEGER;
+	code[ip++].num = 1;
+	gen_2_label(JVM_GOTO, next);
+	gen_label(done);
+	gen_1(JVM_RETURN);
+
+	kernel = emalloc(sizeof(Body));
+	kernel->name = emalloc(strlen(function_name) + 16);
+	sprintf(kernel->name, "%s$loop%d", function_name, nloops);
+	kernel->signature = signature;
+	kernel->idprop = emalloc(sizeof(IDprop));
+	kernel->idprop->type = TYPE_CALLABLE;
+	kernel->idprop->offset = 0;
+	kernel->idprop->nparams = nparams;
+	kernel->idprop->params = params;
+	kernel->code = code;
+	kernel->ip = ip;
+	kernel->variables_width = nlocals;
+	kernel->vars = emalloc((nvars > 0 ? nvars : 1) * sizeof(LocalVar));
+	kernel->nvars = 0;
+	for (i = 0; i < nvars; i++) {
+		if (vars[i].slot < width && param[vars[i].slot] >= 0) {
+			kernel->vars[kernel->nvars].name = estrdup(vars[i].name);
+			kernel->vars[kernel->nvars].type = vars[i].type;
+			kernel->vars[kernel->nvars].spans = whole_method();
+			kernel->vars[kernel->nvars].nspans = 1;
+			kernel->vars[kernel->nvars++].slot = param[vars[i].slot];
+		}
+	}
+	kernel->pure = FALSE;
+	kernel->loop = nloops++;
+	kernel->next = NULL;
+	kernel->prev = NULL;
+	if (kernels == NULL) {
+		kernels = kernel;
+	} else {
+		for (k = kernels; k->next != NULL; k = k->next)
+			;
+		k->next = kernel;
+		kernel->prev = k;
+	}
+
+	/* the caller passes the bounds, which it has computed already, and the
+	 * variables, with the flag clear
+	 */
+	code = caller;
+	ip = caller_ip;
+	code_size = caller_size;
+	for (i = 2; i < flag; i++) {
+		gen_2((params[i] == TYPE_INTEGER ? JVM_ILOAD : JVM_ALOAD), slot[i]);
+	}
+	gen_2(JVM_LDC, 0);
+	ref = emalloc(strlen(class_name) + strlen(kernel->name)
+			+ strlen(signature) + 2);
+	sprintf(ref, "%s/%s%s", class_name, kernel->name, signature);
+	gen_reference(JVM_INVOKESTATIC, ref, CODE_ALLOCATED);
+
+	free(loop);
+	free(kind);
+	free(param);
+	free(slot);
+}
+
 void gen_print(ValType type)
 {
+	if (IS_CALLABLE_TYPE(type)) {
+		SET_RETURN_TYPE(type);
+	}
+	if (IS_ARRAY_TYPE(type) || IS_SLICE_TYPE(type)) {
+		writes_arrays = TRUE;
+		gen_reference(JVM_INVOKESTATIC, array_reference("write", type),
+				CODE_ALLOCATED);
+		return;
+	}
+
 	ensure_space(5);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -448,9 +1508,6 @@ void gen_print(ValType type)
 	code[ip++].code = JVM_INVOKEVIRTUAL;
 
 	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	if (IS_CALLABLE_TYPE(type)) {
-		SET_RETURN_TYPE(type);
-	}
 	if (type == TYPE_BOOLEAN) {
 		code[ip++].string = ref_print_boolean;
 	} else if (type == TYPE_INTEGER) {
@@ -493,6 +1550,14 @@ void gen_print_string(char *string)
 
 void gen_read(ValType type)
 {
+	reads_input = TRUE;
+	if (IS_ARRAY_TYPE(type) || IS_SLICE_TYPE(type)) {
+		reads_arrays = TRUE;
+		gen_reference(JVM_INVOKESTATIC, array_reference("read", type),
+				CODE_ALLOCATED);
+		return;
+	}
+
 	ensure_space(2);
 
 	code[ip].type = CODE_INSTRUCTION;
@@ -510,81 +1575,1339 @@ void gen_read(ValType type)
 	adjust_stack(&instruction_set[JVM_INVOKESTATIC]);
 }
 
-Label get_label(void)
-{
-	static Label label = 1;
-	return label++;
-}
-
-const char *get_opcode_string(Bytecode opcode)
+Boolean gen_switch(int ntests, int *starts, int *ends)
 {
-	if ((unsigned long) opcode < NBYTECODES) {
-		return instruction_set[opcode].instr;
-	} else {
-		return "INVALID OPCODE";
+	int i, n, min, max, *keys;
+	unsigned int offset, off;
+	long table_cost, lookup_cost;
+	Label dflt, first, *targets;
+	Code *sw, label;
+
+	if (ntests < SWITCH_MIN) {
+		return FALSE;
 	}
+
+	keys = emalloc(ntests * sizeof(int));
+	targets = emalloc(ntests * sizeof(Label));
+
+	if (!match_chain(ntests, starts, ends, keys, &offset, &dflt)) {
+		free(keys);
+		free(targets);
+		return FALSE;
+	}
+
+	/* dflt is now the false target of the last test; strip the tests from the
+	 * back, so that the earlier positions remain valid, and label the arms
+	 */
+	for (i = ntests - 1; i > 0; i--) {
+		targets[i] = get_label();
+		label.type = CODE_LABEL;
+		label.label = targets[i];
+		replace_code(starts[i], ends[i], &label, 1);
+	}
+	targets[0] = first = get_label();
+
+	/* sort the keys, with their targets, into ascending order; the first arm
+	 * follows the switch, wherever its key ends up
+	 */
+	for (i = 1; i < ntests; i++) {
+		for (n = i; n > 0 && keys[n - 1] > keys[n]; n--) {
+			min = keys[n];
+			keys[n] = keys[n - 1];
+			keys[n - 1] = min;
+			label.label = targets[n];
+			targets[n] = targets[n - 1];
+			targets[n - 1] = label.label;
+		}
+	}
+	min = keys[0];
+	max = keys[ntests - 1];
+
+	/* choose between the two forms as javac does, weighing time thrice */
+	table_cost = 4 + ((long) max - min + 1) + 3 * 3;
+	lookup_cost = 3 + 2 * (long) ntests + 3 * (long) ntests;
+
+	if (table_cost <= lookup_cost) {
+		n = 2 + 3 + (max - min + 1) + 1 + 1;
+	} else {
+		n = 2 + 2 + 2 * ntests + 1 + 1;
+	}
+	sw = emalloc(n * sizeof(Code));
+
+	n = 0;
+	sw[n].type = CODE_INSTRUCTION;
+	sw[n++].code = JVM_ILOAD;
+	sw[n].type = CODE_OPERAND | CODE_INTEGER;
+	sw[n++].num = offset;
+
+	if (table_cost <= lookup_cost) {
+		sw[n].type = CODE_INSTRUCTION;
+		sw[n++].code = JVM_TABLESWITCH;
+		sw[n].type = CODE_OPERAND | CODE_INTEGER;
+		sw[n++].num = min;
+		sw[n].type = CODE_OPERAND | CODE_INTEGER;
+		sw[n++].num = max;
+		for (i = 0, off = 0; off <= (unsigned int) (max - min); off++) {
+			sw[n].type = CODE_LABEL | CODE_OPERAND;
+			if (keys[i] == min + (int) off) {
+				sw[n++].label = targets[i++];
+			} else {
+				sw[n++].label = dflt;
+			}
+		}
+	} else {
+		sw[n].type = CODE_INSTRUCTION;
+		sw[n++].code = JVM_LOOKUPSWITCH;
+		sw[n].type = CODE_OPERAND | CODE_INTEGER;
+		sw[n++].num = ntests;
+		for (i = 0; i < ntests; i++) {
+			sw[n].type = CODE_OPERAND | CODE_INTEGER;
+			sw[n++].num = keys[i];
+			sw[n].type = CODE_LABEL | CODE_OPERAND;
+			sw[n++].label = targets[i];
+		}
+	}
+
+	sw[n].type = CODE_LABEL | CODE_OPERAND;
+	sw[n++].label = dflt;
+	sw[n].type = CODE_LABEL;
+	sw[n++].label = first;
+
+	replace_code(starts[0], ends[0], sw, n);
+
+	free(sw);
+	free(keys);
+	free(targets);
+
+	return TRUE;
+}
+
+void arrange_arms(int statement, int ntests, int *starts, int *ends,
+		int other, int finish)
+{
+	int i, k, n, len, last, *keys, *order, *from, *to;
+	unsigned int offset;
+	long *freq, *moved;
+	Label dflt;
+	Code *buf;
+
+	if (counts == NULL) {
+		return;
+	}
+	freq = emalloc((ntests + 1) * sizeof(long));
+	for (i = 0; i <= ntests; i++) {
+		if ((freq[i] = frequency(function_name, statement, i)) < 0) {
+			free(freq);
+			return;
+		}
+	}
+
+	/* tests that exclude one another may be made in any order, so the most
+	 * frequent are made first; each test moves with its arm, the jump out of
+	 * the arm, and its false target, which is where the next test starts
+	 */
+	keys = emalloc(ntests * sizeof(int));
+	if (ntests > 1
+			&& match_chain(ntests, starts, ends, keys, &offset, &dflt)) {
+		order = emalloc(ntests * sizeof(int));
+		for (i = 0; i < ntests; i++) {
+			for (k = i; k > 0 && freq[order[k - 1]] < freq[i]; k--) {
+				order[k] = order[k - 1];
+			}
+			order[k] = i;
+		}
+		from = emalloc(ntests * sizeof(int));
+		to = emalloc(ntests * sizeof(int));
+		moved = emalloc(ntests * sizeof(long));
+		memcpy(from, starts, ntests * sizeof(int));
+		memcpy(to, ends, ntests * sizeof(int));
+		memcpy(moved, freq, ntests * sizeof(long));
+		buf = emalloc((other - from[0]) * sizeof(Code));
+		for (n = 0, k = 0; k < ntests; k++) {
+			i = order[k];
+			len = (i + 1 < ntests ? from[i + 1] : other) - from[i];
+			memcpy(&buf[n], &code[from[i]], len * sizeof(Code));
+			starts[k] = from[0] + n;
+			ends[k] = starts[k] + to[i] - from[i];
+			freq[k] = moved[i];
+			n += len;
+		}
+		memcpy(&code[from[0]], buf, n * sizeof(Code));
+		free(buf);
+		free(moved);
+		free(to);
+		free(from);
+		free(order);
+	}
+	free(keys);
+
+	/* the last test falls through to the more frequent of its arm and the
+	 * else arm: the jump is reversed, and the else arm, followed by the jump
+	 * out of it and the target of the test, comes first
+	 */
+	last = ntests - 1;
+	for (i = other; i < finish && code[i].type != CODE_INSTRUCTION; i++)
+		;
+	if (freq[ntests] > freq[last] && i < finish
+			&& IS_INSTRUCTION(code[ends[last] - 2], JVM_IFEQ)
+			&& IS_INSTRUCTION(code[other - 3], JVM_GOTO)
+			&& code[other - 1].type == CODE_LABEL
+			&& code[other - 1].label == code[ends[last] - 1].label) {
+		code[ends[last] - 2].code = JVM_IFNE;
+		rotate_code(ends[last], other - 3, finish);
+		rotate_code(ends[last], ends[last] + 3,
+				ends[last] + 3 + finish - other);
+	}
+
+	free(freq);
+}
+
+Boolean unroll_loop(int test, int body)
+{
+	int i, k, n, end = ip - 3, incr, limit, lines;
+	unsigned int offset;
+	Label top, rest, exit;
+	Code *c, *loop;
+
+	/* line entries generate no code, and do not count towards the size */
+	for (i = body, lines = 0; i < end; i++) {
+		lines += IS_LINE(code[i]) ? 1 : 0;
+	}
+
+	/* the test must be i < c, and the body must end by adding a positive
+	 * constant to i, without assigning to i anywhere else
+	 */
+	if (unroll_factor < 2 || body - test != TEST_LENGTH
+			|| !match_test(test, JVM_IF_ICMPLT, &offset, &limit, &exit)
+			|| !IS_INSTRUCTION(code[test], JVM_ILOAD)
+			|| end - body < 3 || end - body - lines > UNROLL_MAX
+			|| !IS_INSTRUCTION(code[end - 3], JVM_IINC)
+			|| (unsigned int) code[end - 2].num != offset
+			|| code[end - 1].num <= 0) {
+		return FALSE;
+	}
+	incr = code[end - 1].num;
+	for (i = body; i < end - 3; i++) {
+		if ((IS_INSTRUCTION(code[i], JVM_ISTORE)
+					|| IS_INSTRUCTION(code[i], JVM_IINC))
+				&& (unsigned int) code[i + 1].num == offset) {
+			return FALSE;
+		}
+	}
+
+	/* run whole groups of iterations while the last of them would still pass
+	 * the test; if that bound underflows, there can be no whole group
+	 */
+	if ((long) limit - (long) (unroll_factor - 1) * incr < INT_MIN) {
+		return FALSE;
+	}
+	limit -= (unroll_factor - 1) * incr;
+	top = code[test - 1].label;
+	rest = get_label();
+	n = end - body;
+
+	/* unrolled loop, then the original loop for the remaining iterations */
+	loop = emalloc((9 + unroll_factor * n + TEST_LENGTH + n) * sizeof(Code));
+	c = loop;
+	c->type = CODE_INSTRUCTION;
+	(c++)->code = JVM_ILOAD;
+	c->type = CODE_OPERAND | CODE_INTEGER;
+	(c++)->num = offset;
+	c->type = CODE_INSTRUCTION;
+	(c++)->code = JVM_LDC;
+	c->type = CODE_OPERAND | CODE_INTEGER;
+	(c++)->num = limit;
+	c->type = CODE_INSTRUCTION;
+	(c++)->code = JVM_IF_ICMPGE;
+	c->type = CODE_LABEL | CODE_OPERAND;
+	(c++)->label = rest;
+	for (k = 0; k < unroll_factor; k++) {
+		copy_renamed(c, &code[body], n);
+		c += n;
+	}
+	c->type = CODE_INSTRUCTION;
+	(c++)->code = JVM_GOTO;
+	c->type = CODE_LABEL | CODE_OPERAND;
+	(c++)->label = top;
+	c->type = CODE_LABEL;
+	(c++)->label = rest;
+	memcpy(c, &code[test], (TEST_LENGTH + n) * sizeof(Code));
+	c += TEST_LENGTH + n;
+
+	/* the original back jump and exit label follow, jumping to the test of
+	 * the remainder loop instead
+	 */
+	code[end + 1].label = rest;
+	replace_code(test, end, loop, c - loop);
+	free(loop);
+
+	return TRUE;
+}
+
+Boolean is_hot(int statement, int arm)
+{
+	return hot(frequency(function_name, statement, arm));
+}
+
+Boolean is_pure(const char *name)
+{
+	Boolean *pure;
+
+	return ht_search(purity, (void *) name, (void **) &pure) && *pure;
+}
+
+Label get_label(void)
+{
+	static Label label = 1;
+	return label++;
+}
+
+int get_ip(void)
+{
+	return ip;
+}
+
+const char *get_opcode_string(Bytecode opcode)
+{
+	if ((unsigned long) opcode < NBYTECODES) {
+		return instruction_set[opcode].instr;
+	} else {
+		return "INVALID OPCODE";
+	}
+}
+
+void gen_operation(Bytecode opcode, int left, int right)
+{
+	int lneed, rneed, need, k;
+	Boolean lcalls, rcalls;
+
+	lneed = operand_need(left, right, &lcalls);
+	rneed = operand_need(right, ip, &rcalls);
+
+	/* the operands stay where they are until the whole expression is
+	 * generated, so that the code is moved only once
+	 */
+	if (rneed <= lneed || lcalls || rcalls) {
+		need = (lneed > rneed ? lneed : rneed + 1);
+	} else {
+		if (nexchanges == exchanges_size) {
+			exchanges_size = (exchanges_size == 0 ? 16 : 2 * exchanges_size);
+			exchanges = erealloc(exchanges, exchanges_size * sizeof(Exchange));
+		}
+		exchanges[nexchanges].from = left;
+		exchanges[nexchanges].mid = right;
+		exchanges[nexchanges++].to = ip;
+		need = rneed;
+
+		switch (opcode) {
+			case JVM_IADD:
+			case JVM_IAND:
+			case JVM_IF_ICMPEQ:
+			case JVM_IF_ICMPNE:
+			case JVM_IMUL:
+			case JVM_IOR:
+				break;
+			case JVM_IF_ICMPGE:
+				opcode = JVM_IF_ICMPLE;
+				break;
+			case JVM_IF_ICMPGT:
+				opcode = JVM_IF_ICMPLT;
+				break;
+			case JVM_IF_ICMPLE:
+				opcode = JVM_IF_ICMPGE;
+				break;
+			case JVM_IF_ICMPLT:
+				opcode = JVM_IF_ICMPGT;
+				break;
+			default:
+				gen_1(JVM_SWAP);
+				break;
+		}
+	}
+
+	switch (opcode) {
+		case JVM_IF_ICMPEQ:
+		case JVM_IF_ICMPGE:
+		case JVM_IF_ICMPGT:
+		case JVM_IF_ICMPLE:
+		case JVM_IF_ICMPLT:
+		case JVM_IF_ICMPNE:
+			gen_cmp(opcode);
+			break;
+		default:
+			gen_1(opcode);
+			break;
+	}
+
+	/* the operation takes the place of the operations among its operands */
+	for (k = noperands; k > 0 && operands[k - 1].from >= left; k--)
+		;
+	if (k == operands_size) {
+		operands_size = (operands_size == 0 ? 16 : 2 * operands_size);
+		operands = erealloc(operands, operands_size * sizeof(Operand));
+	}
+	operands[k].from = left;
+	operands[k].to = ip;
+	operands[k].need = need;
+	operands[k].calls = lcalls || rcalls;
+	noperands = k + 1;
+}
+
+void place_operands(void)
+{
+	int i, k, from, to, end, n, top, *first, *next, *work;
+	Code *buf;
+
+	noperands = 0;
+	if (nexchanges == 0) {
+		return;
+	}
+
+	/* the exchanges that start at the same place are listed from the
+	 * outermost in, as they were made from the innermost out
+	 */
+	from = exchanges[0].from;
+	to = exchanges[0].to;
+	for (k = 1; k < nexchanges; k++) {
+		from = (exchanges[k].from < from ? exchanges[k].from : from);
+		to = (exchanges[k].to > to ? exchanges[k].to : to);
+	}
+	first = emalloc((to - from) * sizeof(int));
+	next = emalloc(nexchanges * sizeof(int));
+	for (i = 0; i < to - from; i++) {
+		first[i] = -1;
+	}
+	for (k = 0; k < nexchanges; k++) {
+		next[k] = first[exchanges[k].from - from];
+		first[exchanges[k].from - from] = k;
+	}
+
+	/* the stretches of code still to be copied are kept on a stack, with the
+	 * next one on top; an exchange replaces the rest of a stretch with its
+	 * right operand, its left operand, and what follows them
+	 */
+	buf = emalloc((to - from) * sizeof(Code));
+	work = emalloc((4 * nexchanges + 2) * sizeof(int));
+	work[0] = from;
+	work[1] = to;
+	for (top = 2, n = 0; top > 0; ) {
+		end = work[--top];
+		for (i = work[--top]; i < end; i++) {
+			k = first[i - from];
+			if (k >= 0 && exchanges[k].to <= end) {
+				first[i - from] = next[k];
+				work[top++] = exchanges[k].to;
+				work[top++] = end;
+				work[top++] = exchanges[k].from;
+				work[top++] = exchanges[k].mid;
+				work[top++] = exchanges[k].mid;
+				work[top++] = exchanges[k].to;
+				break;
+			}
+			buf[n++] = code[i];
+		}
+	}
+	memcpy(&code[from], buf, n * sizeof(Code));
+
+	free(buf);
+	free(work);
+	free(first);
+	free(next);
+	nexchanges = 0;
+}
+
+void stack_effect(Code *c, int *pop, int *push)
+{
+	const char *d;
+
+	*pop = instruction_set[c->code].pop;
+	*push = instruction_set[c->code].push;
+	if (c->code != JVM_INVOKESTATIC && c->code != JVM_INVOKEVIRTUAL) {
+		return;
+	}
+
+	*pop = (c->code == JVM_INVOKEVIRTUAL ? 1 : 0);
+	for (d = strchr(c[1].string, '(') + 1; *d != ')'; d++) {
+		while (*d == '[') {
+			d++;
+		}
+		if (*d == 'L') {
+			d = strchr(d, ';');
+		}
+		(*pop)++;
+	}
+	*push = (d[1] == 'V' ? 0 : 1);
+}
+
+/* --- code dumping --------------------------------------------------------- */
+
+static void dump_code(FILE *file);
+static void dump_descriptor(FILE *file, IDprop *p);
+static void dump_method(FILE *file, Body *b);
+static Boolean line_has_code(Body *b, int at);
+static int *count_code(Body *b, int *nlines);
+static Boolean find_range(LocalVar *v, LiveRange *s, int *before, int nlines,
+		int *from, int *to);
+static void dump_variables(FILE *file, Body *b, int *before, int nlines);
+static void dump_memo_wrapper(FILE *file, Body *b);
+static void dump_preamble(FILE *file, char *name);
+static void dump_support(FILE *file, char *name);
+static void dump_profiler(FILE *file, char *name);
+static void dump_runner(FILE *file, char *name);
+static Boolean has_loops(void);
+static Boolean is_memoised(Body *b);
+
+void list_code(void)
+{
+	dump_code(stdout);
+}
+
+Boolean loads_variable(int from, unsigned int offset)
+{
+	return ip - from == 2 && IS_INSTRUCTION(code[from], JVM_ILOAD)
+		&& (unsigned int) code[from + 1].num == offset;
+}
+
+void dump_code(FILE *obj_file)
+{
+	Body *b;
+
+	if (memoise) {
+		find_pure_functions(bodies, bodies, class_name);
+	}
+
+	/* preamble */
+	dump_preamble(obj_file, class_name);
+
+	/* dump the methods */
+	for (b = bodies; b; b = b->next) {
+		dump_method(obj_file, b);
+		if (is_memoised(b)) {
+			dump_memo_wrapper(obj_file, b);
+		}
+	}
+}
+
+void make_code_file(void)
+{
+	FILE *obj_file;
+	Body *b;
+
+	/* the methods are out already, and only the methods that support them
+	 * are left to write
+	 */
+	if (streaming) {
+		wait_for_jobs();
+		if (reads_input) {
+			fprintf(stream_file, method_clinit, class_name, class_name,
+					class_name, class_name, class_name, class_name);
+		}
+		dump_support(stream_file, class_name);
+		fclose(stream_file);
+		stream_file = NULL;
+		return;
+	}
+
+	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
+		eprintf("Could not open code file:");
+	}
+
+	/* folding constants across calls may leave some functions unreachable,
+	 * and lowers the stack depths
+	 */
+	wait_for_jobs();
+	propagate_constants(bodies, class_name);
+	remove_dead_functions();
+	for (b = bodies; b != NULL; b = b->next) {
+		add_job(measure_stack, b);
+	}
+	wait_for_jobs();
+	dump_code(obj_file);
+
+	fclose(obj_file);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+static void ensure_space(int num_instr)
+{
+	while (ip + num_instr > code_size) {
+		code = erealloc(code, code_size * 2 * sizeof(Code));
+		code_size *= 2;
+	}
+}
+
+/**
+ * Computes the net change in the stack depth caused by the instruction, and
+ * updates the maximum stack depth if necessary.
+ *
+ * @param[in] instr the instruction for which to factor in the stack effect.
+ */
+static void adjust_stack(BC *instr)
+{
+	stack_depth += instr->push;
+	if (stack_depth > max_stack_depth) {
+		max_stack_depth = stack_depth;
+	}
+	stack_depth -= instr->pop;
+}
+
+/**
+ * Returns the descriptor of the element type of a parameter or return value.
+ * Scalars of both types are passed as integers, but boolean arrays are stored
+ * as compact JVM boolean arrays.
+ *
+ * @param[in] type the type of the parameter or return value.
+ * @return    <code>"Z"</code> for boolean arrays, or <code>"I"</code>
+ *            otherwise.
+ */
+static const char *element_descriptor(ValType type)
+{
+	return (IS_ARRAY_TYPE(type) && IS_BOOLEAN_TYPE(type)) ? "Z" : "I";
+}
+
+/**
+ * Replaces the code for <code>x := x + c</code>, <code>x := c + x</code>, or
+ * <code>x := x - c</code> with a single <code>iinc</code>.  This must be called
+ * just before the <code>istore</code> for <code>x</code> is generated; if the
+ * last three instructions load <code>x</code> and a constant and combine them,
+ * they are the whole of the expression being stored, since the store leaves
+ * the stack empty.
+ *
+ * @param[in] offset the local variable offset of the store.
+ * @return    <code>TRUE</code> if an <code>iinc</code> was generated instead of
+ *            the store, or <code>FALSE</code> otherwise.
+ */
+static Boolean fold_iinc(int offset)
+{
+	Code *c;
+	int incr;
+
+	if (ip < 5) {
+		return FALSE;
+	}
+	c = &code[ip - 5];
+
+	if (c[0].type != CODE_INSTRUCTION || c[2].type != CODE_INSTRUCTION
+			|| c[4].type != CODE_INSTRUCTION
+			|| c[1].type != (CODE_OPERAND | CODE_INTEGER)
+			|| c[3].type != (CODE_OPERAND | CODE_INTEGER)) {
+		return FALSE;
+	}
+
+	if (c[0].code == JVM_ILOAD && c[1].num == offset && c[2].code == JVM_LDC
+			&& (c[4].code == JVM_IADD || c[4].code == JVM_ISUB)) {
+		incr = (c[4].code == JVM_IADD ? c[3].num : -c[3].num);
+	} else if (c[0].code == JVM_LDC && c[2].code == JVM_ILOAD
+			&& c[3].num == offset && c[4].code == JVM_IADD) {
+		incr = c[1].num;
+	} else {
+		return FALSE;
+	}
+
+	if (incr < SHRT_MIN || incr > SHRT_MAX) {
+		return FALSE;
+	}
+
+	/* drop the load, constant, and operator, which leave one value */
+	ip -= 5;
+	stack_depth--;
+
+	code[ip].type = CODE_INSTRUCTION;
+	code[ip++].code = JVM_IINC;
+
+	code[ip].type = CODE_OPERAND | CODE_INTEGER;
+	code[ip++].num = offset;
+
+	code[ip].type = CODE_OPERAND | CODE_INTEGER;
+	code[ip++].num = incr;
+
+	adjust_stack(&instruction_set[JVM_IINC]);
+
+	return TRUE;
+}
+
+/**
+ * Matches the code generated for the condition <code>x = c</code> or
+ * <code>c = x</code> of an if or elsif arm, or a similar comparison, followed
+ * by the jump to the next arm, which is to say,
+ * <code>iload x; ldc c; if_icmpeq L1; ldc 0; goto L2; L1: ldc 1; L2: ifeq
+ * next</code>.
+ *
+ * @param[in]  at     the position of the first instruction of the test.
+ * @param[in]  cmp    the comparison instruction.
+ * @param[out] offset the local variable offset of <code>x</code>.
+ * @param[out] value  the constant <code>c</code>.
+ * @param[out] target the label to which the test jumps if it fails.
+ * @return     <code>TRUE</code> if the code matches, or <code>FALSE</code>
+ *             otherwise.
+ */
+static Boolean match_test(int at, Bytecode cmp, unsigned int *offset,
+		int *value, Label *target)
+{
+	Code *c = &code[at];
+	int i;
+
+	for (i = 0; i < 10; i += 2) {
+		if (c[i].type != CODE_INSTRUCTION) {
+			return FALSE;
+		}
+	}
+	if (c[1].type != (CODE_OPERAND | CODE_INTEGER)
+			|| c[3].type != (CODE_OPERAND | CODE_INTEGER)) {
+		return FALSE;
+	}
+
+	if (c[0].code == JVM_ILOAD && c[2].code == JVM_LDC) {
+		*offset = c[1].num;
+		*value = c[3].num;
+	} else if (c[0].code == JVM_LDC && c[2].code == JVM_ILOAD) {
+		*offset = c[3].num;
+		*value = c[1].num;
+	} else {
+		return FALSE;
+	}
+
+	if (c[4].code != cmp || c[6].code != JVM_LDC
+			|| c[8].code != JVM_GOTO
+			|| c[10].type != CODE_LABEL || c[10].label != c[5].label
+			|| c[11].type != CODE_INSTRUCTION || c[11].code != JVM_LDC
+			|| c[13].type != CODE_LABEL || c[13].label != c[9].label
+			|| c[14].type != CODE_INSTRUCTION || c[14].code != JVM_IFEQ
+			|| c[15].type != (CODE_LABEL | CODE_OPERAND)) {
+		return FALSE;
+	}
+	*target = c[15].label;
+
+	return TRUE;
+}
+
+/**
+ * Determines whether every test in a chain of tests compares the same variable
+ * for equality with a distinct constant.  Such tests exclude one another.
+ *
+ * @param[in]  ntests the number of tests.
+ * @param[in]  starts the positions of the tests.
+ * @param[in]  ends   the positions after the tests and their jumps.
+ * @param[out] keys   the constants, one per test.
+ * @param[out] offset the local variable offset of the variable.
+ * @param[out] dflt   the false target of the last test.
+ * @return     <code>TRUE</code> if the tests match, or <code>FALSE</code>
+ *             otherwise.
+ */
+static Boolean match_chain(int ntests, int *starts, int *ends, int *keys,
+		unsigned int *offset, Label *dflt)
+{
+	int i, n;
+	unsigned int off;
+
+	for (i = 0; i < ntests; i++) {
+		if (ends[i] - starts[i] != TEST_LENGTH
+				|| !match_test(starts[i], JVM_IF_ICMPEQ, &off, &keys[i], dflt)
+				|| (i > 0 && off != *offset)) {
+			return FALSE;
+		}
+		*offset = off;
+		for (n = 0; n < i && keys[n] != keys[i]; n++)
+			;
+		if (n < i) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Copies code, giving every label defined in it a new name, and renaming the
+ * jumps to those labels to match.  Jumps to other labels are left alone, and
+ * allocated strings are duplicated.
+ *
+ * @param[out] dst the destination.
+ * @param[in]  src the code to copy.
+ * @param[in]  n   the number of entries to copy.
+ */
+/**
+ * Generates an instruction with a reference operand.
+ *
+ * @param[in] opcode    the instruction.
+ * @param[in] ref       the reference, which is not copied.
+ * @param[in] allocated <code>CODE_ALLOCATED</code> if the reference is to be
+ *                      freed with the code, or 0 otherwise.
+ */
+static void gen_reference(Bytecode opcode, char *ref, CodeType allocated)
+{
+	ensure_space(2);
+
+	code[ip].type = CODE_INSTRUCTION;
+	code[ip++].code = opcode;
+
+	code[ip].type = CODE_OPERAND | CODE_REFERENCE | allocated;
+	code[ip++].string = ref;
+
+	adjust_stack(&instruction_set[opcode]);
+}
+
+/**
+ * Makes the name of the class followed by a suffix, such as the extension of a
+ * file, or the rest of a reference to a member of the class.
+ *
+ * @param[in] suffix the text that follows the name of the class.
+ * @return    the name and suffix, in newly allocated memory.
+ */
+static char *class_suffixed(const char *suffix)
+{
+	char *s;
+
+	s = emalloc(strlen(class_name) + strlen(suffix) + 1);
+	strcpy(s, class_name);
+	strcat(s, suffix);
+	return s;
+}
+
+/**
+ * Makes the reference to the method of the class that reads or writes an
+ * array, or a slice of one, of the elements of a type.
+ *
+ * @param[in] verb the kind of method, <code>"read"</code> or
+ *                 <code>"write"</code>.
+ * @param[in] type the type of the array or slice.
+ * @return    the reference, in newly allocated memory.
+ */
+static char *array_reference(const char *verb, ValType type)
+{
+	char *ref;
+
+	ref = emalloc(strlen(class_name) + strlen(verb)
+			+ sizeof("/Booleans([ZII)V"));
+	sprintf(ref, "%s/%s%s(%s%s)V", class_name, verb,
+			(IS_BOOLEAN_TYPE(type) ? "Booleans" : "Ints"),
+			(IS_BOOLEAN_TYPE(type) ? "[Z" : "[I"),
+			(IS_SLICE_TYPE(type) ? "II" : ""));
+	return ref;
+}
+
+/**
+ * Determines whether a method reference refers to a method of the class, of
+ * whatever descriptor.
+ *
+ * @param[in] ref    the method reference.
+ * @param[in] method the name of the method.
+ * @return    <code>TRUE</code> if the reference is to the method, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean refers_to(const char *ref, const char *method)
+{
+	size_t n = strlen(class_name), m = strlen(method);
+
+	return strncmp(ref, class_name, n) == 0 && ref[n] == '/'
+		&& strncmp(ref + n + 1, method, m) == 0 && ref[n + 1 + m] == '(';
+}
+
+/**
+ * Determines whether an instruction loads, stores, or increments a local
+ * variable, whose slot is the operand that follows it.
+ *
+ * @param[in] c the code entry.
+ * @return    <code>TRUE</code> if the entry is such an instruction, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean accesses_local(Code *c)
+{
+	return c->type == CODE_INSTRUCTION
+		&& (c->code == JVM_ALOAD || c->code == JVM_ASTORE
+				|| c->code == JVM_IINC || c->code == JVM_ILOAD
+				|| c->code == JVM_ISTORE);
+}
+
+/**
+ * Looks up the type of the named variable of the current function or
+ * procedure in a local variable slot.
+ *
+ * @param[in] slot the slot.
+ * @return    the type of the variable, or <code>TYPE_NONE</code> if no
+ *            variable was declared in the slot.
+ */
+static ValType variable_type(int slot)
+{
+	int i;
+
+	for (i = 0; i < nvars; i++) {
+		if (vars[i].slot == slot) {
+			return vars[i].type;
+		}
+	}
+	return TYPE_NONE;
+}
+
+/**
+ * Creates the stretches of a variable whose liveness is not known, which
+ * span the whole method.
+ *
+ * @return the single stretch, in newly allocated memory.
+ */
+static LiveRange *whole_method(void)
+{
+	LiveRange *s;
+
+	s = emalloc(sizeof(LiveRange));
+	s->from = s->to = -1;
+	return s;
+}
+
+static void copy_renamed(Code *dst, Code *src, int n)
+{
+	int i, j, nlabels = 0;
+	Label *from, *to;
+
+	from = emalloc(n * sizeof(Label));
+	to = emalloc(n * sizeof(Label));
+	for (i = 0; i < n; i++) {
+		if (src[i].type == CODE_LABEL) {
+			from[nlabels] = src[i].label;
+			to[nlabels++] = get_label();
+		}
+	}
+
+	memcpy(dst, src, n * sizeof(Code));
+	for (i = 0; i < n; i++) {
+		if (dst[i].type & CODE_LABEL) {
+			for (j = 0; j < nlabels && from[j] != dst[i].label; j++)
+				;
+			if (j < nlabels) {
+				dst[i].label = to[j];
+			}
+		} else if (dst[i].type & CODE_ALLOCATED) {
+			dst[i].string = estrdup(dst[i].string);
+		}
+	}
+
+	free(from);
+	free(to);
+}
+
+/**
+ * Replaces the code in positions <code>from</code> up to, but not including,
+ * <code>to</code> with <code>nrepl</code> entries from <code>repl</code>,
+ * moving the code that follows as necessary.  Since labels are symbolic, no
+ * jumps need to be adjusted.
+ *
+ * @param[in] from  the first position to replace.
+ * @param[in] to    the position after the last one to replace.
+ * @param[in] repl  the replacement code.
+ * @param[in] nrepl the number of replacement entries.
+ */
+static void replace_code(int from, int to, Code *repl, int nrepl)
+{
+	int delta = nrepl - (to - from);
+
+	if (delta > 0) {
+		ensure_space(delta);
+	}
+	memmove(&code[to + delta], &code[to], (ip - to) * sizeof(Code));
+	memcpy(&code[from], repl, nrepl * sizeof(Code));
+	ip += delta;
+}
+
+/**
+ * Exchanges the code in positions <code>from</code> up to, but not including,
+ * <code>mid</code> with the code from <code>mid</code> up to, but not
+ * including, <code>to</code>.
+ *
+ * @param[in] from the first position of the first block.
+ * @param[in] mid  the first position of the second block.
+ * @param[in] to   the position after the second block.
+ */
+static void rotate_code(int from, int mid, int to)
+{
+	Code *tmp;
+
+	tmp = emalloc((mid - from) * sizeof(Code));
+	memcpy(tmp, &code[from], (mid - from) * sizeof(Code));
+	memmove(&code[from], &code[mid], (to - mid) * sizeof(Code));
+	memcpy(&code[from + to - mid], tmp, (mid - from) * sizeof(Code));
+	free(tmp);
+}
+
+/**
+ * Computes the largest operand stack depth reached by the code of an operand,
+ * in positions <code>from</code> up to, but not including, <code>to</code>,
+ * starting from an empty stack, as it will be once the operands within it are
+ * exchanged.  The code of the operations within it is not measured again, but
+ * taken at the depth found when they were generated.
+ *
+ * @param[in]  from  the first position of the operand.
+ * @param[in]  to    the position after the last one of the operand.
+ * @param[out] calls whether the code invokes a method.
+ * @return     the maximum stack depth.
+ */
+static int operand_need(int from, int to, Boolean *calls)
+{
+	int i, k, depth = 0, max = 0, pop, push;
+
+	for (k = noperands; k > 0 && operands[k - 1].from >= from; k--)
+		;
+	*calls = FALSE;
+	for (i = from; i < to; ) {
+		if (k < noperands && operands[k].from == i && operands[k].to <= to) {
+			if (depth + operands[k].need > max) {
+				max = depth + operands[k].need;
+			}
+			depth++;
+			*calls = *calls || operands[k].calls;
+			i = operands[k++].to;
+			continue;
+		}
+		if (code[i].type == CODE_INSTRUCTION) {
+			stack_effect(&code[i], &pop, &push);
+			depth -= pop;
+			if (depth < 0) {
+				depth = 0;
+			}
+			depth += push;
+			if (depth > max) {
+				max = depth;
+			}
+			if (code[i].code == JVM_INVOKESTATIC
+					|| code[i].code == JVM_INVOKEVIRTUAL) {
+				*calls = TRUE;
+			}
+		}
+		i++;
+	}
+
+	return max;
+}
+
+/**
+ * Computes the largest operand stack depth reached by the code in positions
+ * <code>from</code> up to, but not including, <code>to</code>, starting from an
+ * empty stack.  Unlike the running count kept while generating code, this
+ * takes the arguments of method invocations into account, and restarts at the
+ * depth recorded for a jump to a label after an unconditional jump.
+ *
+ * @param[in] c    the code.
+ * @param[in] from the first position to consider.
+ * @param[in] to   the position after the last one to consider.
+ * @return    the maximum stack depth.
+ */
+static int stack_need(Code *c, int from, int to)
+{
+	int i, depth = 0, max = 0, pop, push, *at;
+	Label minl = (Label) -1, maxl = 0;
+	Boolean reachable = TRUE;
+
+	for (i = from; i < to; i++) {
+		if (c[i].type & CODE_LABEL) {
+			if (c[i].label < minl) {
+				minl = c[i].label;
+			}
+			if (c[i].label > maxl) {
+				maxl = c[i].label;
+			}
+		}
+	}
+	if (minl > maxl) {
+		minl = maxl = 0;
+	}
+	at = emalloc((maxl - minl + 1) * sizeof(int));
+	for (i = 0; i <= (int) (maxl - minl); i++) {
+		at[i] = -1;
+	}
+
+	for (i = from; i < to; i++) {
+		if (c[i].type == CODE_LABEL) {
+			if (!reachable && at[c[i].label - minl] >= 0) {
+				depth = at[c[i].label - minl];
+			}
+			reachable = TRUE;
+		} else if (c[i].type == CODE_INSTRUCTION) {
+			stack_effect(&c[i], &pop, &push);
+			depth -= pop;
+			if (depth < 0) {
+				depth = 0;
+			}
+			depth += push;
+			if (depth > max) {
+				max = depth;
+			}
+			reachable = !ENDS_BLOCK(c[i].code);
+		} else if (IS_TARGET(c[i]) && at[c[i].label - minl] < depth) {
+			at[c[i].label - minl] = depth;
+		}
+	}
+
+	free(at);
+	return max;
+}
+
+/**
+ * Removes the functions and procedures that are never called, directly or
+ * indirectly, from the main program, and reports them if asked to.  Since the
+ * removed code may have been the only code that reads input, or copies,
+ * reads or writes arrays, whether it does is determined anew.
+ */
+static void remove_dead_functions(void)
+{
+	Body *b, *next;
+
+	for (b = remove_unreachable(&bodies, class_name); b != NULL; b = next) {
+		next = b->next;
+		if (list_removed && b->signature == NULL) {
+			fprintf(stderr, "%s: %s: removed unreachable %s '%s'\n",
+					getprogname(), getsrcname(),
+					(b->idprop->type == TYPE_CALLABLE ? "procedure"
+						: "function"), b->name);
+		}
+		release_body(b);
+	}
+
+	reads_input = copies_slices = reads_arrays = writes_arrays = FALSE;
+	for (b = bodies; b != NULL; b = b->next) {
+		note_library_calls(b);
+	}
+}
+
+/**
+ * Notes which of the methods that support the generated code a method body
+ * calls, so that they are written to the class.
+ *
+ * @param[in] b the method body.
+ */
+static void note_library_calls(Body *b)
+{
+	const char *ref;
+	int i;
+
+	for (i = 0; i < b->ip; i++) {
+		if (!IS_INSTRUCTION(b->code[i], JVM_INVOKESTATIC)) {
+			continue;
+		}
+		ref = b->code[i + 1].string;
+		if (strcmp(ref, ref_read_boolean) == 0
+				|| strcmp(ref, ref_read_integer) == 0) {
+			reads_input = TRUE;
+		} else if (strcmp(ref, ref_arr_copy) == 0) {
+			copies_slices = TRUE;
+		} else if (refers_to(ref, "readBooleans")
+				|| refers_to(ref, "readInts")) {
+			reads_input = reads_arrays = TRUE;
+		} else if (refers_to(ref, "writeBooleans")
+				|| refers_to(ref, "writeInts")) {
+			writes_arrays = TRUE;
+		}
+	}
+}
+
+/**
+ * Releases a method body, along with its code.
+ *
+ * @param[in] b the method body.
+ */
+static void release_body(Body *b)
+{
+	strip_body(b);
+	free(b->signature);
+	free(b->name);
+	free(b);
 }
 
-/* --- code dumping --------------------------------------------------------- */
+/**
+ * Releases the code and the variables of a method body, but keeps its name,
+ * signature, and properties.
+ *
+ * @param[in,out] b the method body.
+ */
+static void strip_body(Body *b)
+{
+	int i;
 
-static void dump_code(FILE *file);
-static void dump_method(FILE *file, Body *b);
-static void dump_preamble(FILE *file, char *name);
+	for (i = 0; i < b->ip; i++) {
+		if (b->code[i].type & CODE_ALLOCATED) {
+			free(b->code[i].string);
+		}
+	}
+	free(b->code);
+	for (i = 0; i < b->nvars; i++) {
+		free(b->vars[i].name);
+		free(b->vars[i].spans);
+	}
+	free(b->vars);
+	b->code = NULL;
+	b->ip = 0;
+	b->vars = NULL;
+	b->nvars = 0;
+}
 
-void list_code(void)
+/**
+ * Writes a method to the code file of a streamed class, and releases its code.
+ *
+ * @param[in,out] b the method body.
+ */
+static void stream_method(Body *b)
 {
-	dump_code(stdout);
+	note_library_calls(b);
+	dump_method(stream_file, b);
+	strip_body(b);
 }
 
-void dump_code(FILE *obj_file)
+/**
+ * Removes the code file of a class whose methods were streamed, if the
+ * compiler exits before the file is complete.
+ */
+static void discard_stream(void)
 {
-	Body *b;
+	if (stream_file != NULL) {
+		fclose(stream_file);
+		unlink(jasm_name);
+	}
+}
 
-	/* preamble */
-	dump_preamble(obj_file, class_name);
+/**
+ * Shares slots between the variables of a method body that are never live at
+ * the same time, and sets the maximum stack depth of the body.
+ *
+ * @param[in,out] arg the method body.
+ */
+static void finish_body(void *arg)
+{
+	allocate_locals(arg);
+	measure_stack(arg);
+}
 
-	/* dump the methods */
-	for (b = bodies; b; b = b->next) {
-		dump_method(obj_file, b);
+/**
+ * Sets the maximum stack depth of a method body.
+ *
+ * @param[in,out] arg the method body.
+ */
+static void measure_stack(void *arg)
+{
+	Body *b = arg;
+
+	b->max_stack_depth = stack_need(b->code, 0, b->ip);
+}
+
+/**
+ * Generates a call that counts an execution of the current place in the
+ * source, and records the place.
+ *
+ * @param[in] statement the index of the statement in the current function or
+ *                      procedure, or 0 for its entry.
+ * @param[in] arm       the arm of the statement.
+ */
+static void gen_probe(int statement, int arm)
+{
+	if (nprobes == probes_size) {
+		probes_size = (probes_size == 0 ? INITIAL_SIZE : 2 * probes_size);
+		probes = erealloc(probes, probes_size * sizeof(Probe));
 	}
+	probes[nprobes].name = estrdup(function_name);
+	probes[nprobes].statement = statement;
+	probes[nprobes].arm = arm;
+	probes[nprobes].line = position.line;
+	gen_2(JVM_LDC, nprobes++);
+
+	ensure_space(2);
+
+	code[ip].type = CODE_INSTRUCTION;
+	code[ip++].code = JVM_INVOKESTATIC;
+
+	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
+	code[ip++].string = ref_prof_hit;
+
+	/* the call takes the index, and returns nothing */
+	stack_depth--;
 }
 
-void make_code_file(void)
+/**
+ * Looks up the number of executions of a place in the profile.
+ *
+ * @param[in] name      the function or procedure in which the place lies.
+ * @param[in] statement the index of the statement, or 0 for the entry.
+ * @param[in] arm       the arm of the statement.
+ * @return    the count, or <code>-1</code> if no profile was read, or the
+ *            place is not in it.
+ */
+static long frequency(const char *name, int statement, int arm)
 {
-	FILE *obj_file;
+	char *key;
+	void *value;
+	Boolean found;
 
-	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
-		eprintf("Could not open code file:");
+	if (counts == NULL) {
+		return -1;
 	}
+	key = place_key(name, statement, arm);
+	found = ht_search(counts, key, &value);
+	free(key);
 
-	dump_code(obj_file);
+	return (found ? *(long *) value : -1);
+}
 
-	fclose(obj_file);
+/**
+ * Determines whether a place with the specified number of executions is hot,
+ * that is, whether it runs at least a <code>HOT_RATIO</code>th as often as the
+ * hottest place in the profile.  A place without a count is taken to be hot,
+ * so that code is generated as without a profile.
+ *
+ * @param[in] count the count, or <code>-1</code> if there is none.
+ * @return    <code>TRUE</code> if the place is hot, or <code>FALSE</code>
+ *            otherwise.
+ */
+static Boolean hot(long count)
+{
+	return (count < 0 || hottest == 0
+			|| (count > 0 && count >= hottest / HOT_RATIO));
 }
 
-/* --- utility functions ---------------------------------------------------- */
+/**
+ * Makes the key of a place in the profile table.
+ *
+ * @param[in] name      the function or procedure in which the place lies.
+ * @param[in] statement the index of the statement, or 0 for the entry.
+ * @param[in] arm       the arm of the statement.
+ * @return    the key, which the caller must free.
+ */
+static char *place_key(const char *name, int statement, int arm)
+{
+	char *key;
 
-static void ensure_space(int num_instr)
+	key = emalloc(strlen(name) + 3 * sizeof(int) * 2 + 3);
+	sprintf(key, "%s %d %d", name, statement, arm);
+
+	return key;
+}
+
+/**
+ * Hashes a key of the profile table or of the table of pure functions.
+ *
+ * @param[in] key  the key.
+ * @param[in] size the size of the table.
+ * @return    the hash of the key, less than <code>size</code>.
+ */
+static unsigned int name_hash(void *key, unsigned int size)
 {
-	if (ip + num_instr > code_size) {
-		code = erealloc(code, code_size * 2 * sizeof(Code));
-		code_size *= 2;
+	unsigned int hash = 0;
+	char *k;
+
+	for (k = (char *) key; *k != '\0'; k++) {
+		hash = 31 * hash + (unsigned char) *k;
 	}
+
+	return hash % size;
 }
 
 /**
- * Computes the net change in the stack depth caused by the instruction, and
- * updates the maximum stack depth if necessary.
+ * Compares two keys of the profile table or of the table of pure functions.
  *
- * @param[in] instr the instruction for which to factor in the stack effect.
+ * @param[in] val1 the first key.
+ * @param[in] val2 the second key.
+ * @return    a negative value, zero, or a positive value if the first key is
+ *            less than, equal to, or greater than the second.
  */
-static void adjust_stack(BC *instr)
+static int name_cmp(void *val1, void *val2)
 {
-	stack_depth += instr->push;
-	if (stack_depth > max_stack_depth) {
-		max_stack_depth = stack_depth;
-	}
-	stack_depth -= instr->pop;
+	return strcmp((char *) val1, (char *) val2);
 }
 
 /**
@@ -595,45 +2918,81 @@ static void adjust_stack(BC *instr)
  */
 static void dump_method(FILE *file, Body *b)
 {
-	int i;
+	int i, j, line, from, to, nlines = 0, *before = NULL;
 	unsigned int k;
+	Boolean *labelled = NULL;
 
 	if (strcmp(b->name, "main") == 0) {
 
-		fprintf(file, ".method public static main([Ljava/lang/String;)V\n");
+		fprintf(file, ".method public static main%s([Ljava/lang/String;)V\n",
+				(profile ? IMPL_SUFFIX : ""));
+
+	} else if (b->signature != NULL) {
+
+		fprintf(file, ".method public static %s%s\n", b->name, b->signature);
 
 	} else {
 
-		fprintf(file, ".method public static %s(", b->name);
-		for (k = 0; k < b->idprop->nparams; k++) {
-			if (IS_ARRAY(b->idprop->params[k])) {
-				fputs("[", file);
-			}
-			fputs("I", file);
-		}
-		fprintf(file, ")%s%s\n",
-				(IS_ARRAY_TYPE(b->idprop->type) ? "[" : ""),
-				(b->idprop->type == TYPE_CALLABLE ? "V" : "I"));
+		fprintf(file, ".method public static %s%s", b->name,
+				(is_memoised(b) ? IMPL_SUFFIX : ""));
+		dump_descriptor(file, b->idprop);
+		fputs("\n", file);
 
 	}
 	fprintf(file, ".limit stack %d\n", b->max_stack_depth);
 	fprintf(file, ".limit locals %d\n", b->variables_width);
+	if (b->nvars > 0) {
+		fprintf(file, "Begin:\n");
 
-	for (i = 0; i < b->ip; i++) {
+
+		/* the line entries at which variables come into and go out of use */
+		before = count_code(b, &nlines);
+		labelled = emalloc((nlines + 1) * sizeof(Boolean));
+		for (line = 0; line <= nlines; line++) {
+			labelled[line] = FALSE;
+		}
+		for (i = 0; i < b->nvars; i++) {
+			for (j = 0; j < b->vars[i].nspans; j++) {
+				if (find_range(&b->vars[i], &b->vars[i].spans[j], before,
+							nlines, &from, &to)) {
+					labelled[from < 0 ? nlines : from] = TRUE;
+					labelled[to < 0 ? nlines : to] = TRUE;
+				}
+			}
+		}
+	}
+
+	for (i = 0, line = 0; i < b->ip; i++) {
 
 		Code c = b->code[i];
 
+		if (IS_LINE(c)) {
+			if (labelled != NULL && labelled[line]) {
+				fprintf(file, "P%d:\n", line);
+			}
+			line++;
+		}
+
 		switch (c.type & MASK_TYPE) {
 			case CODE_LABEL:
 				fprintf(file, "L%d:\n", c.label);
 				break;
+			case CODE_MARK:
+				if (IS_LINE(c) && line_has_code(b, i)) {
+					fprintf(file, ".line %d\n", c.num);
+				}
+				break;
 			case CODE_LABEL | CODE_OPERAND:
 				fprintf(file, " L%d\n", c.label);
 				break;
 			case CODE_INSTRUCTION:
 				fprintf(file, "\t%s", get_opcode_string(c.code));
 				switch (c.code) {
+					case JVM_AALOAD:
+					case JVM_AASTORE:
 					case JVM_ARETURN:
+					case JVM_BALOAD:
+					case JVM_BASTORE:
 					case JVM_IADD:
 					case JVM_IALOAD:
 					case JVM_IAND:
@@ -642,15 +3001,45 @@ static void dump_method(FILE *file, Body *b)
 					case JVM_IMUL:
 					case JVM_INEG:
 					case JVM_IOR:
+					case JVM_ISHR:
 					case JVM_ISUB:
 					case JVM_IREM:
 					case JVM_IRETURN:
 					case JVM_IXOR:
+					case JVM_POP:
 					case JVM_RETURN:
 					case JVM_SWAP:
 						/* emit linefeed */
 						fprintf(file, "\n");
 						break;
+					case JVM_IINC:
+						/* the first of two operands: no linefeed */
+						fprintf(file, " %d", b->code[++i].num);
+						break;
+					case JVM_LOOKUPSWITCH:
+						/* the number of pairs, then key-label pairs */
+						k = b->code[++i].num;
+						fprintf(file, "\n");
+						while (k-- > 0) {
+							fprintf(file, "\t\t%d : L%d\n", b->code[i + 1].num,
+									b->code[i + 2].label);
+							i += 2;
+						}
+						fprintf(file, "\t\tdefault : L%d\n",
+								b->code[++i].label);
+						break;
+					case JVM_TABLESWITCH:
+						/* the bounds, then one label per key in range */
+						fprintf(file, " %d %d\n", b->code[i + 1].num,
+								b->code[i + 2].num);
+						k = b->code[i + 2].num - b->code[i + 1].num + 1;
+						i += 2;
+						while (k-- > 0) {
+							fprintf(file, "\t\tL%d\n", b->code[++i].label);
+						}
+						fprintf(file, "\t\tdefault : L%d\n",
+								b->code[++i].label);
+						break;
 					default:
 						/* no linefeed */
 						break;
@@ -684,13 +3073,200 @@ static void dump_method(FILE *file, Body *b)
 	}
 
 	/* guard against a dangling label at the end of the code stream */
-	if ((b->code[b->ip - 1].type & MASK_TYPE) == CODE_LABEL) {
+	for (i = b->ip - 1;
+			i > 0 && (b->code[i].type & MASK_TYPE) == CODE_MARK; i--)
+		;
+	if ((b->code[i].type & MASK_TYPE) == CODE_LABEL) {
 		fprintf(file, "\tnop\n");
 	}
 
+	if (b->nvars > 0) {
+		fprintf(file, "Finish:\n");
+		dump_variables(file, b, before, nlines);
+		free(before);
+		free(labelled);
+	}
+
 	fprintf(file, ".end method\n\n");
 }
 
+/**
+ * Determines whether any code follows a line entry before the next one.  The
+ * line number table may not refer to the end of the code.
+ *
+ * @param[in] b  the method body.
+ * @param[in] at the position of the line entry.
+ * @return    <code>TRUE</code> if an instruction follows the line entry
+ *            before the next line entry, or <code>FALSE</code> otherwise.
+ */
+static Boolean line_has_code(Body *b, int at)
+{
+	int i;
+
+	for (i = at + 1; i < b->ip && !IS_LINE(b->code[i]); i++) {
+		if (b->code[i].type == CODE_INSTRUCTION) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Counts the instructions of a method body before each of its line entries.
+ *
+ * @param[in]  b      the method body.
+ * @param[out] nlines the number of line entries.
+ * @return     the number of instructions before every line entry, followed by
+ *             the number in the whole body, in newly allocated memory.
+ */
+static int *count_code(Body *b, int *nlines)
+{
+	int i, n, k, *before;
+
+	for (i = 0, n = 0; i < b->ip; i++) {
+		n += (IS_LINE(b->code[i]) ? 1 : 0);
+	}
+	before = emalloc((n + 1) * sizeof(int));
+	for (i = 0, n = 0, k = 0; i < b->ip; i++) {
+		if (IS_LINE(b->code[i])) {
+			before[n++] = k;
+		} else if (b->code[i].type == CODE_INSTRUCTION) {
+			k++;
+		}
+	}
+	before[n] = k;
+	*nlines = n;
+
+	return before;
+}
+
+/**
+ * Finds the line entries between which a variable is live in one stretch.
+ *
+ * @param[in]  v      the variable.
+ * @param[in]  s      the stretch.
+ * @param[in]  before the number of instructions before every line entry.
+ * @param[in]  nlines the number of line entries.
+ * @param[out] from   the line entry where the range starts, or -1 for the
+ *                    start of the method.
+ * @param[out] to     the line entry where the range ends, or -1 for the end
+ *                    of the method.
+ * @return     <code>TRUE</code> if the variable is used, and some code is left
+ *             in its range, or <code>FALSE</code> otherwise.
+ */
+static Boolean find_range(LocalVar *v, LiveRange *s, int *before, int nlines,
+		int *from, int *to)
+{
+	*from = (s->from < nlines ? s->from : -1);
+	*to = (s->to < nlines ? s->to : -1);
+
+	return v->slot >= 0 && (*to < 0 ? before[nlines] : before[*to])
+		> (*from < 0 ? 0 : before[*from]);
+}
+
+/**
+ * Writes the local variable table of a method, in which every variable is
+ * listed once for every stretch of statements in which it is live, or once
+ * for the whole method if those are not known, so that variables that share a
+ * slot are listed apart.  Variables that are unused, and stretches that have
+ * no code left in them, are left out.
+ *
+ * @param[in] file   the output file.
+ * @param[in] b      the body of the method.
+ * @param[in] before the number of instructions before every line entry.
+ * @param[in] nlines the number of line entries.
+ */
+static void dump_variables(FILE *file, Body *b, int *before, int nlines)
+{
+	int i, j, from, to;
+	LocalVar *v;
+
+	for (i = 0; i < b->nvars; i++) {
+		v = &b->vars[i];
+		for (j = 0; j < v->nspans; j++) {
+			if (!find_range(v, &v->spans[j], before, nlines, &from, &to)) {
+				continue;
+			}
+
+			fprintf(file, ".var %d is '%s", v->slot, v->name);
+			if (v->type == TYPE_NONE) {
+				fprintf(file, "' [Ljava/lang/String;");
+			} else {
+				fprintf(file, "' %s%s", (IS_ARRAY_TYPE(v->type) ? "[" : ""),
+						element_descriptor(v->type));
+			}
+			if (from < 0) {
+				fprintf(file, " from Begin");
+			} else {
+				fprintf(file, " from P%d", from);
+			}
+			if (to < 0) {
+				fprintf(file, " to Finish\n");
+			} else {
+				fprintf(file, " to P%d\n", to);
+			}
+		}
+	}
+}
+
+/**
+ * Writes the method descriptor of a function or procedure.
+ *
+ * @param[in] file the output file.
+ * @param[in] p    the properties of the function or procedure identifier.
+ */
+static void dump_descriptor(FILE *file, IDprop *p)
+{
+	unsigned int k;
+
+	fputs("(", file);
+	for (k = 0; k < p->nparams; k++) {
+		if (IS_ARRAY(p->params[k])) {
+			fputs("[", file);
+		}
+		fputs(element_descriptor(p->params[k]), file);
+	}
+	fprintf(file, ")%s%s",
+			(IS_ARRAY_TYPE(p->type) ? "[" : ""),
+			(p->type == TYPE_CALLABLE ? "V" : element_descriptor(p->type)));
+}
+
+/**
+ * Writes the method that memoises a function in its place.  The wrapper looks
+ * up its arguments in the cache of the function, and on a miss, calls the
+ * renamed original, and stores the result in the entry of the arguments, over
+ * whatever was there.  Since the original calls the function by name, its
+ * recursive calls go through the wrapper, too.
+ *
+ * @param[in] file the output file.
+ * @param[in] b    the body of the function.
+ */
+static void dump_memo_wrapper(FILE *file, Body *b)
+{
+	unsigned int k, nparams = b->idprop->nparams;
+	unsigned int key = nparams, entry = nparams + 2, result = nparams + 3;
+	const char *desc = (nparams == 1 ? "(I)I" : "(II)I");
+	char *name = b->name;
+
+	/* the key is kept after the arguments, and its entry and the result
+	 * after the key, which takes two slots
+	 */
+	fprintf(file, memo_lookup, name, desc, result + 1, class_name, name,
+			1 << MEMO_BITS, class_name, name, 1 << MEMO_BITS, class_name,
+			name, 1 << MEMO_BITS, class_name, name);
+	fputs((nparams == 1 ? memo_key_1 : memo_key_2), file);
+	fprintf(file, memo_entry, key, key, MEMO_HASH, 32 - MEMO_BITS, entry);
+	fprintf(file, memo_hit, class_name, name, entry, class_name, name, entry,
+			key, class_name, name, entry);
+	for (k = 0; k < nparams; k++) {
+		fprintf(file, "\tiload %u\n", k);
+	}
+	fprintf(file, memo_store, class_name, name, desc, result, class_name,
+			name, entry, key, class_name, name, entry, result, class_name,
+			name, entry, result);
+}
+
 /**
  * Writes the preamble to the Jasmin output file.  The preamble consists of (i)
  * the class name and visibility specifier, (ii) the superclass, and (iii) the
@@ -701,10 +3277,201 @@ static void dump_method(FILE *file, Body *b)
  */
 static void dump_preamble(FILE *file, char *name)
 {
-	fprintf(file, class_preamble, name, name, name, name, name, name, name);
+	Body *b;
+
+	fprintf(file, class_preamble, name);
+	if (has_loops()) {
+		fputs(par_fields, file);
+	}
+	for (b = bodies; b; b = b->next) {
+		if (is_memoised(b)) {
+			fprintf(file, memo_field, b->name, b->name, b->name);
+		}
+	}
+	if (reads_input) {
+		fputs(input_fields, file);
+		fprintf(file, method_clinit, name, name, name, name, name, name);
+	}
+	if (profile) {
+		fputs(prof_field, file);
+	}
 	fputs(method_init, file);
-	fprintf(file, method_readInt, name);
-	fprintf(file, method_readBoolean, name);
+	dump_support(file, name);
+}
+
+/**
+ * Writes the methods that the generated code calls for input, profiling,
+ * parallel loops, and arrays, as far as it needs them.
+ *
+ * @param[in] file the output file.
+ * @param[in] name the name of the class.
+ */
+static void dump_support(FILE *file, char *name)
+{
+	if (reads_input) {
+		fprintf(file, method_readInt, name);
+		fprintf(file, method_readBoolean, name);
+	}
+	if (profile) {
+		dump_profiler(file, name);
+	}
+	if (has_loops()) {
+		dump_runner(file, name);
+	}
+	if (copies_slices) {
+		fputs(method_arr_copy, file);
+	}
+	if (reads_arrays) {
+		fprintf(file, method_read_array, "Ints", "[I", name, "Ints", "[I",
+				"Ints", "[I", name, "Int", "I", "iastore");
+		fprintf(file, method_read_array, "Booleans", "[Z", name, "Booleans",
+				"[Z", "Booleans", "[Z", name, "Boolean", "Z", "bastore");
+	}
+	if (writes_arrays) {
+		fprintf(file, method_write_array, "Ints", "[I", name, "Ints", "[I",
+				"Ints", "[I", "iaload", "I");
+		fprintf(file, method_write_array, "Booleans", "[Z", name, "Booleans",
+				"[Z", "Booleans", "[Z", "baload", "Z");
+	}
+}
+
+/**
+ * Writes the methods that count executions, and write the counts out, in a
+ * profiled class, along with the <code>main</code> method that wraps the main
+ * program.  The places whose executions are counted are described in strings
+ * of at most <code>PROF_CHUNK</code> places each, to keep within the limit on
+ * the length of a constant.
+ *
+ * @param[in] file the output file.
+ * @param[in] name the name of the class.
+ */
+static void dump_profiler(FILE *file, char *name)
+{
+	int i, j;
+
+	fprintf(file, method_prof_hit, name);
+	fprintf(file, method_prof_print, name);
+	fprintf(file, method_prof_report_head, name);
+	for (i = 0; i < nprobes; i += PROF_CHUNK) {
+		fputs("\taload 0\n\tldc\t\"", file);
+		for (j = i; j < nprobes && j < i + PROF_CHUNK; j++) {
+			fprintf(file, "%s%s %d %d %d ", (j > i ? ";" : ""),
+					probes[j].name, probes[j].statement, probes[j].arm,
+					probes[j].line);
+		}
+		fprintf(file, "\"\n\tldc %d\n", i);
+		fprintf(file, "\tinvokestatic %s/prof$print"
+				"(Ljava/io/PrintStream;Ljava/lang/String;I)V\n", name);
+	}
+	fputs(method_prof_report_tail, file);
+	fprintf(file, method_prof_main, nprobes, name, name, name, name);
+}
+
+/**
+ * Writes the method that runs a part of a parallel loop in an instance of the
+ * class, and the one that splits the range of a loop into parts, and waits
+ * for them.  Every part of a loop runs the method of the loop, with arguments
+ * unpacked from the fields of its instance, and with the flag set.
+ *
+ * @param[in] file the output file.
+ * @param[in] name the name of the class.
+ */
+static void dump_runner(FILE *file, char *name)
+{
+	static const char *carriers[] = {
+		"par$ints [I", "par$arrays [[I", "par$flags [[Z"
+	};
+	Body *b;
+	ValType t;
+	unsigned int p, count[3];
+	int k, c, stack = 1;
+
+	for (b = bodies; b != NULL; b = b->next) {
+		if (b->loop >= 0 && (int) b->idprop->nparams > stack) {
+			stack = b->idprop->nparams;
+		}
+	}
+	fprintf(file, method_par_run_head, stack, name, nloops - 1);
+	for (k = 0; k < nloops; k++) {
+		for (b = bodies; b != NULL && b->loop != k; b = b->next)
+			;
+		if (b != NULL) {
+			fprintf(file, "\t\tLoop%d\n", k);
+		} else {
+			fputs("\t\tDone\n", file);
+		}
+	}
+	fputs("\t\tdefault : Done\n", file);
+
+	for (b = bodies; b != NULL; b = b->next) {
+		if (b->loop < 0) {
+			continue;
+		}
+		fprintf(file, "Loop%d:\n", b->loop);
+		count[0] = count[1] = count[2] = 0;
+		for (p = 0; p + 1 < b->idprop->nparams; p++) {
+			t = b->idprop->params[p];
+			c = (!IS_ARRAY_TYPE(t) ? 0 : IS_BOOLEAN_TYPE(t) ? 2 : 1);
+			fprintf(file, "\taload_0\n\tgetfield %s/%s\n\tldc %u\n\t%s\n",
+					name, carriers[c], count[c]++,
+					(c == 0 ? "iaload" : "aaload"));
+		}
+		fprintf(file, "\ticonst_1\n\tinvokestatic %s/%s%s\n\treturn\n",
+				name, b->name, b->signature);
+	}
+	fputs(method_par_run_tail, file);
+	fprintf(file, method_par_split, name, name, name, name, name, name);
+}
+
+/**
+ * Determines whether any parallel loops remain in the class, after the
+ * unreachable functions and procedures have been removed.
+ *
+ * @return    <code>TRUE</code> if the class has a parallel loop, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean has_loops(void)
+{
+	Body *b;
+
+	for (b = bodies; b != NULL; b = b->next) {
+		if (b->loop >= 0) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Determines whether a function is memoised: memoisation must be enabled, and
+ * the function must be pure, and take one or two scalar arguments, and return
+ * a scalar.  Scalars of both types are passed as integers.  If a profile was
+ * read, the function must also be called often.  Since the caches are not
+ * safe to share between threads, nothing is memoised in a class with parallel
+ * loops, and since their fields would have to be declared before it is known
+ * which functions are pure, nothing is memoised in a streamed class either.
+ *
+ * @param[in] b the body of the function.
+ * @return    <code>TRUE</code> if the function is memoised, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean is_memoised(Body *b)
+{
+	unsigned int k;
+
+	if (!memoise || streaming || !b->pure || b->signature != NULL
+			|| b->idprop->type == TYPE_CALLABLE
+			|| IS_ARRAY_TYPE(b->idprop->type)
+			|| b->idprop->nparams < 1 || b->idprop->nparams > MEMO_ARGS
+			|| !hot(frequency(b->name, 0, 0)) || has_loops()) {
+		return FALSE;
+	}
+	for (k = 0; k < b->idprop->nparams; k++) {
+		if (IS_ARRAY_TYPE(b->idprop->params[k])) {
+			return FALSE;
+		}
+	}
+	return TRUE;
 }
 
 void release_code_generation(void)
@@ -728,6 +3495,19 @@ void release_code_generation(void)
 		free(d);
 	}
 
+	/* free the counted places */
+
+	for (i = 0; i < nprobes; i++) {
+		free(probes[i].name);
+	}
+	free(probes);
+	free(operands);
+	free(exchanges);
+	if (counts != NULL) {
+		ht_free(counts, free, free);
+	}
+	ht_free(purity, free, free);
+
 	/* free strings */
 
 	free(class_name);
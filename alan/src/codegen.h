@@ -14,6 +14,35 @@
 
 typedef unsigned int Label;
 
+/**
+ * Lays out the arms of the if statement that has just been generated by how
+ * often they ran in the profile, if one was read.  Tests that compare the
+ * same scalar variable against distinct constants exclude one another, and
+ * are reordered so that the most frequent are made first.  The last test
+ * then falls through to whichever of its arm and the else arm ran more often.
+ * Nothing changes if there is no profile, or if it has no count for some arm
+ * of the statement.
+ *
+ * @param[in]   statement
+ *     the index of the statement in the current function or procedure
+ * @param[in]   ntests
+ *     the number of tests in the chain
+ * @param[in,out]   starts
+ *     the code positions (see <code>get_ip</code>) at which the tests start,
+ *     updated to where the tests are moved
+ * @param[in,out]   ends
+ *     the code positions just after the false jumps of the tests, updated to
+ *     where the tests are moved
+ * @param[in]   other
+ *     the code position at which the else arm starts, just after the false
+ *     target of the last test
+ * @param[in]   finish
+ *     the code position at which the else arm ends, just before the label at
+ *     the end of the statement
+ */
+void arrange_arms(int statement, int ntests, int *starts, int *ends,
+		int other, int finish);
+
 /**
  * Assembles a Jasmin file.  The file must first be written by calling
  * <code>make_code_file</code>.
@@ -24,7 +53,10 @@ typedef unsigned int Label;
 void assemble(const char *jasmin_path);
 
 /**
- * Closes the code generation for the current function or procedure.
+ * Closes the code generation for the current function or procedure.  If the
+ * class is streamed (see <code>set_streaming</code>), the methods of the
+ * function or procedure are written to the code file, and their code is
+ * released.
  *
  * @param[in]   varwidth
  *     the length of the local variable array, including space for parameters;
@@ -32,6 +64,19 @@ void assemble(const char *jasmin_path);
  */
 void close_subroutine_codegen(int varwidth);
 
+/**
+ * Records a named local variable of the current function or procedure, for
+ * the local variable table of its method.
+ *
+ * @param[in]   name
+ *     the name of the variable
+ * @param[in]   type
+ *     the type of the variable
+ * @param[in]   offset
+ *     the local variable offset of the variable
+ */
+void declare_variable(const char *name, ValType type, unsigned int offset);
+
 /**
  * Generates the code for an operation that does not have an operand.
  *
@@ -40,6 +85,21 @@ void close_subroutine_codegen(int varwidth);
  */
 void gen_1(Bytecode opcode);
 
+/**
+ * Marks the start of an arm of a statement: the body of a while loop (arm
+ * <code>0</code>), or an arm of an if statement, numbered from
+ * <code>0</code> for its first test to the number of tests for its else arm,
+ * whether or not it has one.  In a profiled class, the executions of the arm
+ * are counted.
+ *
+ * @param[in]   statement
+ *     the index of the statement in the current function or procedure,
+ *     counting from <code>1</code>
+ * @param[in]   arm
+ *     the arm of the statement
+ */
+void gen_arm(int statement, int arm);
+
 /**
  * Generates a label.
  *
@@ -48,6 +108,22 @@ void gen_1(Bytecode opcode);
  */
 void gen_label(Label label);
 
+/**
+ * Records the source line of the statement whose code is generated next, for
+ * the line number table of the method.  A line generates no code.
+ *
+ * @param[in]   line
+ *     the source line of the statement
+ */
+void gen_line(int line);
+
+/**
+ * Marks a boundary between two statements at the top level of the body of the
+ * current function or procedure.  A mark generates no code, but a method that
+ * is too large may be split into smaller ones at its marks.
+ */
+void gen_mark(void);
+
 /**
  * Generates the code for an operation with one operand.
  *
@@ -87,6 +163,37 @@ void gen_call(char *fname, IDprop *idprop);
  */
 void gen_cmp(Bytecode opcode);
 
+/**
+ * Generates the code that copies a slice of one array into a slice of another,
+ * or of the same, array.  The destination array, the start of its slice, and
+ * the end of it (exclusive), must be on the stack, followed by those of the
+ * source.  The slices must have the same length, or the copy fails.
+ */
+void gen_copy(void);
+
+/**
+ * Generates the code that compares two slices of arrays, element by element,
+ * which leaves one on the stack if they are equal, or zero otherwise.  Every
+ * slice is on the stack as its array, the start of the slice, and the end of
+ * it (exclusive).
+ *
+ * @param[in]   type
+ *     the type of the arrays
+ * @param[in]   equal
+ *     whether the test is for equality or for inequality
+ */
+void gen_equals(ValType type, Boolean equal);
+
+/**
+ * Generates the code that stores a value into every element of a slice of an
+ * array.  The array, the start of the slice, the end of it (exclusive), and
+ * the value must be on the stack.
+ *
+ * @param[in]   type
+ *     the type of the array
+ */
+void gen_fill(ValType type);
+
 /**
  * Generates the instruction that creates a new array of the specified type.
  *
@@ -96,7 +203,27 @@ void gen_cmp(Bytecode opcode);
 void gen_newarray(JVMatype atype);
 
 /**
- * Generates the instructions for the displaying output on screen.
+ * Turns the body of a parallel loop, which has just been generated, into a
+ * method of its own, and calls that method in its place.  The bounds of the
+ * loop, which precede the body, are passed to the method, followed by the
+ * variables that the body reads.  Unless it runs a part of the range already,
+ * the method splits the range among the processors, and runs each part on the
+ * common fork/join pool, waiting for all of them to finish.  The body stores
+ * only into array elements, so that the scalar variables of the caller, the
+ * loop variable among them, are left unchanged.
+ *
+ * @param[in]   body
+ *     the code position (see <code>get_ip</code>) at which the body starts,
+ *     just after the bounds
+ * @param[in]   offset
+ *     the local variable slot of the loop variable
+ */
+void gen_parallel(int body, unsigned int offset);
+
+/**
+ * Generates the instructions for the displaying output on screen.  The
+ * elements of an array, or of a slice of one, are displayed separated by
+ * single spaces, and reach the output stream all at once.
  *
  * @param[in]   type
  *     the operand type
@@ -112,13 +239,70 @@ void gen_print(ValType type);
 void gen_print_string(char *string);
 
 /**
- * Generates the instructions for reading from standard input into a variable.
+ * Generates the instructions for reading from standard input into a variable,
+ * or into every element of an array, or of a slice of one, in turn.  For an
+ * array or a slice, the array (and the bounds of the slice) must be on the
+ * stack.
  *
  * @param[in]   type
  *     the operand type
  */
 void gen_read(ValType type);
 
+/**
+ * Replaces the tests of an if-elsif chain with a single
+ * <code>tableswitch</code> or <code>lookupswitch</code>, if every arm compares
+ * the same scalar variable against a distinct integer constant, and there are
+ * enough arms to make it worthwhile.  Tests that fail fall through to the
+ * else part (or the end of the statement) as before.
+ *
+ * @param[in]   ntests
+ *     the number of tests in the chain
+ * @param[in]   starts
+ *     the code positions (see <code>get_ip</code>) at which the tests start
+ * @param[in]   ends
+ *     the code positions just after the false jumps of the tests
+ * @return      <code>TRUE</code> if the tests were replaced, or
+ *              <code>FALSE</code> if the code was left unchanged
+ */
+Boolean gen_switch(int ntests, int *starts, int *ends);
+
+/**
+ * Returns the current instruction pointer, which is to say, the position in
+ * the code array at which the next instruction will be generated.
+ *
+ * @return      the current instruction pointer.
+ */
+int get_ip(void);
+
+/**
+ * Determines whether an arm of a statement in the current function or
+ * procedure is hot, which is to say, whether it ran at least a hundredth as
+ * often as the most frequent place in the profile.  Without a profile, or
+ * without a count for the arm, every arm is hot.
+ *
+ * @param[in]   statement
+ *     the index of the statement
+ * @param[in]   arm
+ *     the arm of the statement
+ * @return      <code>TRUE</code> if the arm is hot, or <code>FALSE</code>
+ *              otherwise
+ */
+Boolean is_hot(int statement, int arm);
+
+/**
+ * Determines whether a function or procedure, which must have been compiled
+ * already, is pure, which is to say, neither reads input, nor writes output,
+ * nor stores into arrays it receives as parameters, and calls only pure
+ * functions and procedures.
+ *
+ * @param[in]   name
+ *     the name of the function or procedure
+ * @return      <code>TRUE</code> if it is pure, or <code>FALSE</code> if it
+ *              is not, or if it has not been compiled yet
+ */
+Boolean is_pure(const char *name);
+
 /**
  * Returns the next label integer.
  *
@@ -161,18 +345,175 @@ void init_subroutine_codegen(const char *name, IDprop *p);
 void list_code(void);
 
 /**
- * Opens the object file, and write the generated code to it.
+ * Determines whether the code generated from a position onwards is just a
+ * load of a scalar variable.
+ *
+ * @param[in]   from
+ *     the code position (see <code>get_ip</code>) at which to start
+ * @param[in]   offset
+ *     the local variable slot of the variable
+ * @return      <code>TRUE</code> if the code loads the variable, and does
+ *              nothing else, or <code>FALSE</code> otherwise
+ */
+Boolean loads_variable(int from, unsigned int offset);
+
+/**
+ * Opens the object file, and write the generated code to it.  If the class is
+ * streamed, only the methods that support the generated code are left to
+ * write, after which the file is closed.
  */
 void make_code_file(void);
 
+/**
+ * Writes a launcher script for the class, and creates a class data sharing
+ * archive for it with a training run of the class, without input.  The
+ * script runs the class with the archive, if there is one, and with virtual
+ * machine options suited to short runs.  The class must first be assembled
+ * by calling <code>assemble</code>.
+ */
+void make_launcher(void);
+
+/**
+ * Generates a binary operator, whose left operand has been generated, followed
+ * by its right one.  The operands are evaluated in the order that needs the
+ * least room on the operand stack (Sethi-Ullman order).  If the right operand
+ * needs more room, it is to be moved in front of the left one, and either the
+ * opcode is adjusted for the exchanged operands, or, for an operator that is
+ * not commutative, a <code>swap</code> is generated.  The operands are left
+ * alone if either of them calls a method, since the calls might have side
+ * effects.  The code is moved only by <code>place_operands</code>, which must
+ * be called once the whole expression is generated.
+ *
+ * @param[in]   opcode
+ *     the arithmetic, logical, or integer comparison instruction to apply to
+ *     the operands
+ * @param[in]   left
+ *     the code position (see <code>get_ip</code>) at which the left operand
+ *     starts
+ * @param[in]   right
+ *     the code position at which the right operand starts
+ */
+void gen_operation(Bytecode opcode, int left, int right);
+
+/**
+ * Moves the operands of the binary operators of an expression, which has just
+ * been generated, into the order chosen for them (see
+ * <code>gen_operation</code>), in one pass over its code.  Until then, the
+ * code of an expression stays in the order in which it was generated, so that
+ * the code positions within it stay valid.
+ */
+void place_operands(void);
+
+/**
+ * Reads the counts written by a profiled class (see
+ * <code>set_profiling</code>), which guide the layout of if statements, the
+ * unrolling of loops, and the memoisation of functions.  This must be called
+ * before any code is generated.
+ *
+ * @param[in]   path
+ *     the path of the profile
+ */
+void read_profile(const char *path);
+
+/**
+ * Enables or disables the report, on the standard error stream, of the
+ * functions and procedures that are removed from the class file because they
+ * cannot be reached from the main program.
+ *
+ * @param[in]   enable
+ *     whether to report removed functions and procedures
+ */
+void set_list_removed(Boolean enable);
+
+/**
+ * Enables or disables the memoisation of pure functions.  A memoised function
+ * keeps the results of its calls in a cache of fixed size, keyed by their
+ * arguments, and returns one when called again with the same arguments; a
+ * new result takes the place of any other in its entry.  Only functions that
+ * take one or two scalar arguments, and return a scalar, are memoised.
+ *
+ * @param[in]   enable
+ *     whether to memoise pure functions
+ */
+void set_memoisation(Boolean enable);
+
+/**
+ * Tells the code generator whether parallel loops are compiled, so that a
+ * streamed class declares the fields that they need only if so.  This must be
+ * called before <code>set_class_name</code>.
+ *
+ * @param[in]   enable
+ *     whether parallel loops are compiled
+ */
+void set_parallel_code(Boolean enable);
+
+/**
+ * Enables or disables profiling.  A profiled class counts how often every
+ * function and procedure is entered, and how often every arm of their if and
+ * while statements runs (see <code>gen_arm</code>), and writes the counts to
+ * a file named after the class, with extension <code>.prof</code>, when the
+ * main program returns or fails.  Every line of the file names a function (or
+ * <code>main</code>), the index of a statement in it, or <code>0</code> for
+ * its entry, the arm of the statement, and the source line, followed by the
+ * count.  This must be called before any code is generated.
+ *
+ * @param[in]   enable
+ *     whether to profile the class
+ */
+void set_profiling(Boolean enable);
+
+/**
+ * Enables or disables streaming, in which every method is written to the code
+ * file as soon as its function or procedure is closed, and its code released,
+ * so that only one function is held at a time.  Since the class is then never
+ * seen as a whole, constants are not propagated across calls, unreachable
+ * functions are not removed, and nothing is memoised; the fields that the
+ * class may need are all declared.  This must be called before
+ * <code>set_class_name</code>.
+ *
+ * @param[in]   enable
+ *     whether to stream the class
+ */
+void set_streaming(Boolean enable);
+
 /**
  * Sets the name of the class file.  This must be called after
  * <code>init_code_generation</code>, but before any other code is emitted.
+ * If the class is streamed, the code file is opened, and its fields are
+ * written.
  *
  * @param[in] cname the name of the class file
  */
 void set_class_name(char *cname);
 
+/**
+ * Sets the number of copies of the body of a counted loop to run in every
+ * iteration of an unrolled loop.
+ *
+ * @param[in]   factor
+ *     the unrolling factor; a factor less than two disables unrolling
+ */
+void set_unroll_factor(int factor);
+
+/**
+ * Unrolls the while loop that has just been generated, if its condition is
+ * <code>i &lt; c</code> for a constant <code>c</code>, and its body, which may
+ * not otherwise assign to <code>i</code>, ends by adding a positive constant
+ * to <code>i</code>.  Copies of the body run in groups for as long as the
+ * last iteration of a group would still pass the test, after which the
+ * original loop runs the remaining iterations.
+ *
+ * @param[in]   test
+ *     the code position (see <code>get_ip</code>) at which the condition
+ *     starts, just after the label at the top of the loop
+ * @param[in]   body
+ *     the code position at which the body starts, just after the jump out of
+ *     the loop
+ * @return      <code>TRUE</code> if the loop was unrolled, or
+ *              <code>FALSE</code> if the code was left unchanged
+ */
+Boolean unroll_loop(int test, int body);
+
 /**
  * Releases the resources allocated or held by the code generation unit.
  */
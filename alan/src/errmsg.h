@@ -14,6 +14,7 @@ typedef enum {
 	ERR_EXPRESSION_OR_STRING_EXPECTED,
 	ERR_FACTOR_EXPECTED,
 	ERR_ILLEGAL_ARRAY_OPERATION,
+	ERR_ILLEGAL_IN_PARALLEL_LOOP,
 	ERR_LEAVE_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE,
 	ERR_MISSING_LEAVE_EXPRESSION_FOR_FUNCTION,
 	ERR_MULTIPLE_DEFINITION,
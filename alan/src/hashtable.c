@@ -135,6 +135,7 @@ int ht_insert(HashTab *ht, void *key, void *value)
 				p = (HTentry*) malloc(sizeof(HTentry));
 				p->value = value;
 				p->key = key;
+				p->next_ptr = NULL;
 				ht->table[k] = p;
 				ht->num_entries++;
 
@@ -185,13 +186,14 @@ Boolean ht_search(HashTab *ht, void *key, void **value)
 int ht_free(HashTab *ht, void (*freekey)(void *k), void (*freeval)(void *v))
 {
 	unsigned int i;
-	HTentry *p;
+	HTentry *p, *q;
 
 	/* free the nodes in the buckets */
 	/* free the table and container */
 
 	for (i = 0; i < ht->size; i++) {
-		for (p = ht->table[i]; p != NULL; p = p->next_ptr) {
+		for (p = ht->table[i]; p != NULL; p = q) {
+			q = p->next_ptr;
 			freekey(p->key);
 			freeval(p->value);
 			free(p);
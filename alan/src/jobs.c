@@ -0,0 +1,158 @@
+/**
+ * @file    jobs.c
+ * @brief   A pool of threads on which the compiler runs independent jobs.
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @date    2022-08-03
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "error.h"
+#include "jobs.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+typedef struct {
+	void  (*run)(void *arg);           /* the function that does the job      */
+	void   *arg;                       /* its argument                        */
+} Job;
+
+#define INITIAL_JOBS  64
+
+/* --- global static variables ---------------------------------------------- */
+
+static pthread_t       *threads;       /* the threads of the pool             */
+static int              nthreads;      /* the number of threads               */
+static Job             *queue;         /* the jobs that wait for a thread     */
+static int              head;          /* the next job to run                 */
+static int              tail;          /* just past the last job to run       */
+static int              queue_size;    /* the space for jobs                  */
+static int              running;       /* the jobs taken, but not done        */
+static Boolean          stopping;      /* whether the threads should stop     */
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   added = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   done = PTHREAD_COND_INITIALIZER;
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void *work(void *arg);
+
+/* --- jobs interface ------------------------------------------------------- */
+
+void init_jobs(int njobs)
+{
+	int i;
+
+	head = tail = running = 0;
+	stopping = FALSE;
+	nthreads = (njobs > 1 ? njobs : 0);
+	if (nthreads == 0) {
+		return;
+	}
+
+	queue_size = INITIAL_JOBS;
+	queue = emalloc(queue_size * sizeof(Job));
+	threads = emalloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, work, NULL) != 0) {
+			eprintf("could not start a thread for the jobs of the compiler");
+		}
+	}
+}
+
+void add_job(void (*run)(void *arg), void *arg)
+{
+	if (nthreads == 0) {
+		run(arg);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (tail == queue_size) {
+		if (head > 0) {
+			memmove(queue, queue + head, (tail - head) * sizeof(Job));
+			tail -= head;
+			head = 0;
+		} else {
+			queue_size *= 2;
+			queue = erealloc(queue, queue_size * sizeof(Job));
+		}
+	}
+	queue[tail].run = run;
+	queue[tail].arg = arg;
+	tail++;
+	pthread_cond_signal(&added);
+	pthread_mutex_unlock(&lock);
+}
+
+void wait_for_jobs(void)
+{
+	if (nthreads == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	while (head < tail || running > 0) {
+		pthread_cond_wait(&done, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void release_jobs(void)
+{
+	int i;
+
+	if (nthreads == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	stopping = TRUE;
+	pthread_cond_broadcast(&added);
+	pthread_mutex_unlock(&lock);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(queue);
+	nthreads = 0;
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/* runs the jobs in the queue, one at a time, and once it is empty, waits for
+ * more, until the pool is stopped
+ */
+void *work(void *arg)
+{
+	Job job;
+
+	(void) arg;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (head == tail && !stopping) {
+			pthread_cond_wait(&added, &lock);
+		}
+		if (head == tail) {
+			break;
+		}
+		job = queue[head++];
+		if (head == tail) {
+			head = tail = 0;
+		}
+		running++;
+		pthread_mutex_unlock(&lock);
+
+		job.run(job.arg);
+
+		pthread_mutex_lock(&lock);
+		running--;
+		if (head == tail && running == 0) {
+			pthread_cond_broadcast(&done);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
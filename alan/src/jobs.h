@@ -0,0 +1,44 @@
+/**
+ * @file    jobs.h
+ * @brief   A pool of threads on which the compiler runs independent jobs.
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @date    2022-08-03
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+/**
+ * Starts the threads of the pool.  With a single job at a time, no thread is
+ * started, and every job runs as soon as it is added, on the calling thread.
+ *
+ * @param[in]   njobs
+ *     the number of jobs to run at the same time
+ */
+void init_jobs(int njobs);
+
+/**
+ * Adds a job to the pool, which runs it on the next thread that is free.  Jobs
+ * may run in any order, and at the same time as one another, and as the
+ * calling thread; a job must therefore not change anything that the others,
+ * or the calling thread, use before the next call to <code>wait_for_jobs</code>.
+ *
+ * @param[in]   run
+ *     the function that does the job
+ * @param[in]   arg
+ *     the argument to pass to <code>run</code>
+ */
+void add_job(void (*run)(void *arg), void *arg);
+
+/**
+ * Waits until every job added so far has run.
+ */
+void wait_for_jobs(void);
+
+/**
+ * Waits for the jobs that are left, stops the threads of the pool, and
+ * releases its resources.
+ */
+void release_jobs(void);
+
+#endif /* JOBS_H */
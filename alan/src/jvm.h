@@ -22,9 +22,14 @@ typedef enum {
 
 /* JVM bytecodes */
 typedef enum {
+	JVM_AALOAD,
+	JVM_AASTORE,
 	JVM_ALOAD,
+	JVM_ANEWARRAY,
 	JVM_ARETURN,
 	JVM_ASTORE,
+	JVM_BALOAD,
+	JVM_BASTORE,
 	JVM_GETSTATIC,
 	JVM_GOTO,
 	JVM_IADD,
@@ -33,27 +38,33 @@ typedef enum {
 	JVM_IASTORE,
 	JVM_IDIV,
 	JVM_IFEQ,
+	JVM_IFNE,
 	JVM_IF_ICMPEQ,
 	JVM_IF_ICMPGE,
 	JVM_IF_ICMPGT,
 	JVM_IF_ICMPLE,
 	JVM_IF_ICMPLT,
 	JVM_IF_ICMPNE,
+	JVM_IINC,
 	JVM_ILOAD,
 	JVM_IMUL,
 	JVM_INEG,
 	JVM_INVOKESTATIC,
 	JVM_INVOKEVIRTUAL,
 	JVM_IOR,
+	JVM_ISHR,
 	JVM_ISTORE,
 	JVM_ISUB,
 	JVM_IREM,
 	JVM_IRETURN,
 	JVM_IXOR,
 	JVM_LDC,
+	JVM_LOOKUPSWITCH,
 	JVM_NEWARRAY,
+	JVM_POP,
 	JVM_RETURN,
-	JVM_SWAP
+	JVM_SWAP,
+	JVM_TABLESWITCH
 } Bytecode;
 
 #endif /* JVM_H */
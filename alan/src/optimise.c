@@ -0,0 +1,2546 @@
+/**
+ * @file    optimise.c
+ * @brief   Optimisation passes over the generated code of ALAN-2022 methods.
+ *
+ * The passes work on the code array of a method body after it has been
+ * generated, using a control flow graph over its instructions.  Since labels
+ * are symbolic, code may be rewritten in place without adjusting jumps.
+ *
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @date    2022-08-03
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "bytecode.h"
+#include "error.h"
+#include "jobs.h"
+#include "optimise.h"
+#include "valtypes.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+typedef unsigned long Word;
+
+#define WORD_BITS       (sizeof(Word) * CHAR_BIT)
+#define NWORDS(n)       (((n) + WORD_BITS - 1) / WORD_BITS)
+#define SET_BIT(s, i)   ((s)[(i) / WORD_BITS] |= 1UL << ((i) % WORD_BITS))
+#define HAS_BIT(s, i)   (((s)[(i) / WORD_BITS] >> ((i) % WORD_BITS)) & 1UL)
+
+/* HotSpot does not compile methods with more bytecode bytes than this */
+#define METHOD_SIZE_LIMIT  8000
+/* the size up to which statements are grouped into one part of a method */
+#define PART_SIZE          4000
+/* parts smaller than this do not repay the cost of the call */
+#define MIN_PART_SIZE      64
+
+/* folding a constant may expose more; give up after this many passes */
+#define FOLD_PASSES        8
+/* a range that has grown this often where paths meet is widened */
+#define WIDEN_AFTER        2
+/* the most values kept for the ranges of a body; deeper stacks go unfolded */
+#define RANGES_LIMIT       (1 << 22)
+
+/* a part receives its variables in an integer array, an array of integer
+ * arrays, and an array of boolean arrays, which are also its parameter slots
+ */
+#define NCARRIERS          3
+#define PART_SIGNATURE     "([I[[I[[Z)V"
+
+/* the method that counts the runs of a place in the program, when profiling */
+#define PROBE_METHOD       "/prof$hit(I)V"
+
+/** the control flow graph of a method body, with instructions as nodes */
+typedef struct {
+	int  ninstr;  /**< the number of instructions                         */
+	int *pos;     /**< the code position of every instruction             */
+	int *first;   /**< where the successors of every instruction start    */
+	int *succ;    /**< the successor instruction indices, back to back    */
+} Flow;
+
+/** the kind of value held in a local variable slot */
+typedef enum {
+	KIND_NONE,
+	KIND_INT,
+	KIND_REF
+} Kind;
+
+/** the local variables used, defined, and live at every instruction */
+typedef struct {
+	int   nvars;  /**< the number of local variable slots                 */
+	int   nw;     /**< the number of words in the set of every instruction */
+	Kind *kind;   /**< the kind of value held in every slot                */
+	Word *use;    /**< the slots read by every instruction                 */
+	Word *def;    /**< the slots written by every instruction              */
+	Word *in;     /**< the slots live before every instruction             */
+	Word *out;    /**< the slots live after every instruction              */
+} Liveness;
+
+/** a growable code array */
+typedef struct {
+	Code *code;  /**< the code                 */
+	int   ip;    /**< the number of entries    */
+	int   size;  /**< the allocated entries    */
+} Buffer;
+
+/** what is known about a value at some point in a method */
+typedef enum {
+	VALUE_UNSET,
+	VALUE_RANGE
+} Certainty;
+
+/** a value in a local variable slot or on the operand stack: the range in
+ * which it lies, and, for a value on the stack, the variable from which it was
+ * loaded, if the variable has not been assigned to since */
+typedef struct {
+	Certainty known;  /**< whether the range has been set      */
+	int       lo;     /**< the smallest value it may have      */
+	int       hi;     /**< the largest value it may have       */
+	int       slot;   /**< the variable it equals, or -1       */
+} Value;
+
+#define IS_CONSTANT(v)  ((v).known == VALUE_RANGE && (v).lo == (v).hi)
+#define LOWER(a, b)     ((a) < (b) ? (a) : (b))
+#define HIGHER(a, b)    ((a) > (b) ? (a) : (b))
+
+/** the ranges of the values in the local variables and on the stack before
+ * every instruction of a method body */
+typedef struct {
+	int    nvars;  /**< the number of local variable slots                  */
+	int    width;  /**< the number of values per instruction: the slots,
+	                    followed by the deepest stack                       */
+	int   *depth;  /**< the stack depth before every instruction, or -1 if
+	                    the instruction is never reached                    */
+	Value *value;  /**< the values before every instruction, back to back  */
+	int   *grown;  /**< how often the values before every instruction have
+	                    grown where paths meet                              */
+	Label  minl;   /**< the smallest label in the body                      */
+	int    nat;    /**< the number of labels from the smallest one          */
+	int   *at;     /**< the instruction at every label                      */
+} Ranges;
+
+/** a stretch in which a variable is live, with the slot of the variable */
+typedef struct {
+	LiveRange *span;  /**< the stretch                      */
+	int   slot;  /**< the slot of the variable         */
+} SlotSpan;
+
+/** a method body to fold, with the values of its parameters on entry */
+typedef struct {
+	Body  *b;       /**< the method body                   */
+	Value *params;  /**< the values of the parameters      */
+} Fold;
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void build_flow(Body *b, Flow *f);
+static void release_flow(Flow *f);
+static Boolean compute_liveness(Body *b, Flow *f, Liveness *l);
+static void release_liveness(Liveness *l);
+static Kind local_access(Code *c, Boolean *uses, Boolean *defines);
+static Word *new_sets(int nsets, int nbits);
+static void add_span(LocalVar *v, int *size, int from, int to);
+static void separate_spans(Body *b, int nlines);
+static int compare_spans(const void *a, const void *b);
+static Body *make_part(Body *b, Flow *f, Liveness *l, ValType *elem,
+		int from, int to, int nparts, const char *class_name, Buffer *caller);
+static void infer_elements(Body *b, Flow *f, ValType *elem);
+static int code_length(Code *c, int from, int to);
+static Boolean returns(Code *c, int from, int to);
+static int instruction_at(Flow *f, int pos);
+static void emit(Buffer *buf, CodeType type, int num);
+static void emit_ref(Buffer *buf, Bytecode opcode, char *ref);
+static Boolean has_effects(Body *b);
+static Body *find_callee(Body *bodies, const char *ref,
+		const char *class_name);
+static Boolean is_probe(const char *ref, const char *class_name);
+static int body_index(Body *bodies, Body *b);
+static void thread_comparisons(Body *b);
+static Boolean compute_ranges(Body *b, Flow *f, Value *params, Ranges *k);
+static void release_ranges(Ranges *k);
+static Boolean transfer(Code *c, Value *in, int depth, Ranges *k,
+		Value *out, int *out_depth);
+static void forget_slot(Value *from, Value *to, int v);
+static Boolean merge_values(Ranges *k, int from, int to, Value *out,
+		int depth, Boolean *changed);
+static Value constant(int num);
+static Value varying(void);
+static Value make_range(long long lo, long long hi);
+static Value arithmetic(Bytecode opcode, Value *a, Value *b);
+static Value combine(Bytecode opcode, Value *a, Value *b);
+static long long shift_right(long long x, int s);
+static Boolean is_conditional(Bytecode opcode);
+static Bytecode negate(Bytecode opcode);
+static Boolean refine(Code *c, Value *sp, Value *state, Boolean holds);
+static Boolean narrow(Value *state, int slot, long long lo, long long hi);
+static Boolean decide_switch(Code *c, Value *sp, Label *target);
+static void gather_arguments(Body *b, Body *bodies, const char *class_name,
+		Value *params, Value **seen);
+static Boolean fold_body(Body *b, Value *params);
+static void fold_job(void *arg);
+static void emit_pop(Buffer *buf);
+static Boolean drop_pushed(Buffer *buf);
+static void remove_jumps_to_next(Buffer *buf);
+static void remove_unused_labels(Buffer *buf);
+
+/* --- optimisation interface ----------------------------------------------- */
+
+void allocate_locals(Body *b)
+{
+	Flow f;
+	Liveness l;
+	Code *c = b->code;
+	int nvars, nw, nfixed, k, s, v, w, nslots, i, n, first, size;
+	int *colour, *lines;
+	Kind *slot_kind;
+	Word *conflict, *taken;
+	Boolean uses, defines, live;
+
+	nvars = b->variables_width;
+	if (nvars <= 0) {
+		return;
+	}
+	nfixed = (strcmp(b->name, "main") == 0 ? 1 : (int) b->idprop->nparams);
+	nw = NWORDS(nvars);
+
+	/* give up on a slot that is accessed as both an integer and a reference */
+	build_flow(b, &f);
+	if (!compute_liveness(b, &f, &l)) {
+		goto done;
+	}
+
+	/* a definition conflicts with everything live after it; on entry, the
+	 * parameters are defined while anything read before being set is live
+	 */
+	conflict = new_sets(nvars, nvars);
+	for (k = 0; k < f.ninstr; k++) {
+		for (v = 0; v < nvars; v++) {
+			if (!HAS_BIT(&l.def[k * nw], v)) {
+				continue;
+			}
+			for (w = 0; w < nvars; w++) {
+				if (w != v && HAS_BIT(&l.out[k * nw], w)) {
+					SET_BIT(&conflict[v * nw], w);
+					SET_BIT(&conflict[w * nw], v);
+				}
+			}
+		}
+	}
+	for (v = 0; v < nvars; v++) {
+		for (w = 0; w < nvars; w++) {
+			if (v != w && (v < nfixed || (f.ninstr > 0 && HAS_BIT(l.in, v)))
+					&& (w < nfixed || (f.ninstr > 0 && HAS_BIT(l.in, w)))) {
+				SET_BIT(&conflict[v * nw], w);
+			}
+		}
+	}
+
+	/* colour greedily in slot order, never mixing kinds in a slot */
+	colour = emalloc(nvars * sizeof(int));
+	slot_kind = emalloc(nvars * sizeof(Kind));
+	taken = new_sets(1, nvars);
+	for (v = 0; v < nvars; v++) {
+		slot_kind[v] = (v < nfixed ? l.kind[v] : KIND_NONE);
+		colour[v] = (v < nfixed ? v : -1);
+	}
+	nslots = nfixed;
+	for (v = nfixed; v < nvars; v++) {
+		if (l.kind[v] == KIND_NONE) {
+			continue;
+		}
+		memset(taken, 0, nw * sizeof(Word));
+		for (w = 0; w < nvars; w++) {
+			if (colour[w] >= 0 && HAS_BIT(&conflict[v * nw], w)) {
+				SET_BIT(taken, colour[w]);
+			}
+		}
+		for (s = 0; HAS_BIT(taken, s)
+				|| (slot_kind[s] != KIND_NONE && slot_kind[s] != l.kind[v]); s++)
+			;
+		colour[v] = s;
+		slot_kind[s] = l.kind[v];
+		if (s + 1 > nslots) {
+			nslots = s + 1;
+		}
+	}
+
+	/* since its slot may be shared, a variable is listed once for every
+	 * stretch of statements in which it is live, the first of a parameter
+	 * from the start; the statements are counted in line entries, which stay
+	 * in place as the code is folded later
+	 */
+	lines = emalloc((f.ninstr + 1) * sizeof(int));
+	for (i = 0, n = 0, k = 0; k < f.ninstr; k++) {
+		for (; i < f.pos[k]; i++) {
+			n += (IS_LINE(c[i]) ? 1 : 0);
+		}
+		lines[k] = n;
+	}
+	for (; i < b->ip; i++) {
+		n += (IS_LINE(c[i]) ? 1 : 0);
+	}
+	for (k = 0; k < b->nvars; k++) {
+		v = b->vars[k].slot;
+		if (v < 0 || (v >= nfixed && l.kind[v] == KIND_NONE)) {
+			continue;
+		}
+		b->vars[k].nspans = 0;
+		size = 1;
+		for (i = 0, first = -1; i <= f.ninstr; i++) {
+			live = i < f.ninstr && (HAS_BIT(&l.in[i * nw], v)
+					|| HAS_BIT(&l.def[i * nw], v));
+			if (live && first < 0) {
+				first = i;
+			} else if (!live && first >= 0) {
+				add_span(&b->vars[k], &size, (v < nfixed
+							&& b->vars[k].nspans == 0 ? -1
+							: lines[first] - 1), lines[i - 1]);
+				first = -1;
+			}
+		}
+		if (v < nfixed && b->vars[k].nspans == 0) {
+			add_span(&b->vars[k], &size, -1, 0);
+		}
+	}
+	free(lines);
+
+	/* rewrite the local variable operands */
+	for (k = 0; k < f.ninstr; k++) {
+		if (local_access(&c[f.pos[k]], &uses, &defines) != KIND_NONE) {
+			c[f.pos[k] + 1].num = colour[c[f.pos[k] + 1].num];
+		}
+	}
+	for (k = 0; k < b->nvars; k++) {
+		b->vars[k].slot = colour[b->vars[k].slot];
+	}
+	b->variables_width = nslots;
+	separate_spans(b, n);
+
+	free(colour);
+	free(slot_kind);
+	free(taken);
+	free(conflict);
+
+done:
+	release_liveness(&l);
+	release_flow(&f);
+}
+
+Body *split_method(Body *b, const char *class_name)
+{
+	Flow f;
+	Liveness l;
+	Buffer caller;
+	Body *head, *tail, *part;
+	Code *c = b->code;
+	ValType *elem;
+	int *marks, nmarks, m, n, size, len, done, nparts;
+
+	if (code_length(c, 0, b->ip) <= METHOD_SIZE_LIMIT) {
+		return NULL;
+	}
+
+	build_flow(b, &f);
+	if (!compute_liveness(b, &f, &l)) {
+		release_liveness(&l);
+		release_flow(&f);
+		return NULL;
+	}
+	elem = emalloc(l.nvars * sizeof(ValType));
+	infer_elements(b, &f, elem);
+
+	marks = emalloc(b->ip * sizeof(int));
+	for (nmarks = 0, m = 0; m < b->ip; m++) {
+		if (c[m].type == CODE_MARK) {
+			marks[nmarks++] = m;
+		}
+	}
+
+	/* group consecutive statements, none of which returns, into parts, and
+	 * replace each part with a call to a new method
+	 */
+	caller.code = emalloc(b->ip * sizeof(Code));
+	caller.size = b->ip;
+	caller.ip = 0;
+	head = tail = NULL;
+	done = nparts = 0;
+	for (m = 0; m + 1 < nmarks; m = (n > m ? n : m + 1)) {
+		size = 0;
+		for (n = m; n + 1 < nmarks && !returns(c, marks[n], marks[n + 1]);
+				n++) {
+			len = code_length(c, marks[n], marks[n + 1]);
+			if (n > m && size + len > PART_SIZE) {
+				break;
+			}
+			size += len;
+		}
+		if (size < MIN_PART_SIZE) {
+			continue;
+		}
+
+		for (; done < marks[m]; done++) {
+			emit(&caller, c[done].type, 0);
+			caller.code[caller.ip - 1] = c[done];
+		}
+		part = make_part(b, &f, &l, elem, marks[m], marks[n], nparts++,
+				class_name, &caller);
+		done = marks[n];
+
+		if (head == NULL) {
+			head = part;
+			part->prev = b;
+		} else {
+			tail->next = part;
+			part->prev = tail;
+		}
+		tail = part;
+	}
+	for (; done < b->ip; done++) {
+		emit(&caller, c[done].type, 0);
+		caller.code[caller.ip - 1] = c[done];
+	}
+
+	if (nparts > 0) {
+		b->variables_width += NCARRIERS;
+	}
+	free(b->code);
+	b->code = caller.code;
+	b->ip = caller.ip;
+
+	free(marks);
+	free(elem);
+	release_liveness(&l);
+	release_flow(&f);
+
+	return head;
+}
+
+Body *remove_unreachable(Body **bodies, const char *class_name)
+{
+	Body *b, *callee, *removed, *tail, **work;
+	Boolean *reached;
+	int i, nwork, nbodies;
+
+	for (nbodies = 0, b = *bodies; b != NULL; b = b->next) {
+		nbodies++;
+	}
+	work = emalloc(nbodies * sizeof(Body *));
+	reached = emalloc(nbodies * sizeof(Boolean));
+	for (i = 0, b = *bodies; b != NULL; b = b->next, i++) {
+		reached[i] = FALSE;
+	}
+
+	/* follow the edges of the call graph, which are the invocations in the
+	 * bodies, from main
+	 */
+	nwork = 0;
+	for (i = 0, b = *bodies; b != NULL; b = b->next, i++) {
+		if (strcmp(b->name, "main") == 0) {
+			reached[i] = TRUE;
+			work[nwork++] = b;
+		}
+	}
+	while (nwork > 0) {
+		b = work[--nwork];
+		for (i = 0; i < b->ip; i++) {
+			if (!IS_INSTRUCTION(b->code[i], JVM_INVOKESTATIC)
+					|| (callee = find_callee(*bodies, b->code[i + 1].string,
+							class_name)) == NULL
+					|| reached[body_index(*bodies, callee)]) {
+				continue;
+			}
+			reached[body_index(*bodies, callee)] = TRUE;
+			work[nwork++] = callee;
+		}
+	}
+
+	/* move the bodies that were not reached to a list of their own, keeping
+	 * their order
+	 */
+	removed = tail = NULL;
+	for (i = 0, b = *bodies; b != NULL; i++) {
+		Body *next = b->next;
+		if (!reached[i]) {
+			if (b->prev != NULL) {
+				b->prev->next = next;
+			} else {
+				*bodies = next;
+			}
+			if (next != NULL) {
+				next->prev = b->prev;
+			}
+			b->prev = tail;
+			b->next = NULL;
+			if (tail != NULL) {
+				tail->next = b;
+			} else {
+				removed = b;
+			}
+			tail = b;
+		}
+		b = next;
+	}
+
+	free(reached);
+	free(work);
+
+	return removed;
+}
+
+void propagate_constants(Body *bodies, const char *class_name)
+{
+	Body *b;
+	Fold *folds;
+	Value **assumed, **seen;
+	int i, p, nbodies, round;
+	Boolean stable = FALSE;
+
+	for (nbodies = 0, b = bodies; b != NULL; b = b->next) {
+		nbodies++;
+	}
+	assumed = emalloc((nbodies + 1) * sizeof(Value *));
+	seen = emalloc((nbodies + 1) * sizeof(Value *));
+	for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+		thread_comparisons(b);
+		assumed[i] = emalloc((b->idprop->nparams + 1) * sizeof(Value));
+		seen[i] = emalloc((b->idprop->nparams + 1) * sizeof(Value));
+		for (p = 0; p < (int) b->idprop->nparams; p++) {
+			assumed[i][p] = varying();
+		}
+	}
+
+	/* assume some parameters are constant, and collect the arguments of the
+	 * calls that can then be reached; if every call passes what was assumed,
+	 * the assumption holds, by induction on the depth of calls from main
+	 */
+	for (round = 0; !stable && round <= nbodies + 1; round++) {
+		for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+			for (p = 0; p < (int) b->idprop->nparams; p++) {
+				seen[i][p].known = VALUE_UNSET;
+			}
+		}
+		for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+			gather_arguments(b, bodies, class_name, assumed[i], seen);
+		}
+		stable = TRUE;
+		for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+			for (p = 0; p < (int) b->idprop->nparams; p++) {
+				if (seen[i][p].known == VALUE_UNSET) {
+					seen[i][p] = varying();
+				}
+				if (IS_CONSTANT(seen[i][p]) != IS_CONSTANT(assumed[i][p])
+						|| seen[i][p].lo != assumed[i][p].lo) {
+					stable = FALSE;
+				}
+				assumed[i][p] = seen[i][p];
+			}
+		}
+	}
+	if (!stable) {
+		for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+			for (p = 0; p < (int) b->idprop->nparams; p++) {
+				assumed[i][p] = varying();
+			}
+		}
+	}
+
+	/* the bodies are folded on their own, and so, at the same time */
+	folds = emalloc((nbodies + 1) * sizeof(Fold));
+	for (i = 0, b = bodies; b != NULL; b = b->next, i++) {
+		folds[i].b = b;
+		folds[i].params = assumed[i];
+		add_job(fold_job, &folds[i]);
+	}
+	wait_for_jobs();
+	for (i = 0; i < nbodies; i++) {
+		free(assumed[i]);
+		free(seen[i]);
+	}
+	free(folds);
+	free(assumed);
+	free(seen);
+}
+
+void find_pure_functions(Body *bodies, Body *from, const char *class_name)
+{
+	Body *b;
+	Code *c;
+	Boolean changed;
+	int i;
+
+	for (b = from; b != NULL; b = b->next) {
+		b->pure = !has_effects(b);
+	}
+
+	/* a body that calls one that is not pure is not pure either; starting from
+	 * the optimistic guess lets mutually recursive functions stay pure; the
+	 * probes of a profile only count, and leave a body pure
+	 */
+	do {
+		changed = FALSE;
+		for (b = from; b != NULL; b = b->next) {
+			for (c = b->code, i = 0; b->pure && i < b->ip; i++) {
+				if (IS_INSTRUCTION(c[i], JVM_INVOKESTATIC)
+						&& !is_probe(c[i + 1].string, class_name)) {
+					Body *callee = find_callee(bodies, c[i + 1].string,
+							class_name);
+					if (callee == NULL || !callee->pure) {
+						b->pure = FALSE;
+						changed = TRUE;
+					}
+				}
+			}
+		}
+	} while (changed);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Builds the control flow graph of a method body.  Jumps to a label at the
+ * very end of the body, and falling off the last instruction, lead out of the
+ * method, and are not recorded as successors.
+ *
+ * @param[in]  b the method body.
+ * @param[out] f the control flow graph.
+ */
+static void build_flow(Body *b, Flow *f)
+{
+	Code *c = b->code;
+	int i, j, k, n, *at;
+	Label minl, maxl;
+
+	f->ninstr = 0;
+	minl = (Label) -1;
+	maxl = 0;
+	for (i = 0; i < b->ip; i++) {
+		if (c[i].type == CODE_INSTRUCTION) {
+			f->ninstr++;
+		} else if (c[i].type == CODE_LABEL) {
+			if (c[i].label < minl) {
+				minl = c[i].label;
+			}
+			if (c[i].label > maxl) {
+				maxl = c[i].label;
+			}
+		}
+	}
+	if (minl > maxl) {
+		minl = maxl = 0;
+	}
+
+	/* instruction positions, and the instruction at which each label is */
+	f->pos = emalloc((f->ninstr + 1) * sizeof(int));
+	at = emalloc((maxl - minl + 1) * sizeof(int));
+	for (i = 0; i <= (int) (maxl - minl); i++) {
+		at[i] = f->ninstr;
+	}
+	for (i = 0, k = 0; i < b->ip; i++) {
+		if (c[i].type == CODE_INSTRUCTION) {
+			f->pos[k++] = i;
+		} else if (c[i].type == CODE_LABEL) {
+			at[c[i].label - minl] = k;
+		}
+	}
+	f->pos[k] = b->ip;
+
+	/* count, then record, the successors */
+	f->first = emalloc((f->ninstr + 1) * sizeof(int));
+	for (n = 0, k = 0; k < f->ninstr; k++) {
+		f->first[k] = n;
+		n += ENDS_BLOCK(c[f->pos[k]].code) ? 0 : 1;
+		for (j = f->pos[k] + 1; j < b->ip && (c[j].type & CODE_OPERAND); j++) {
+			n += IS_TARGET(c[j]) ? 1 : 0;
+		}
+	}
+	f->first[k] = n;
+
+	f->succ = emalloc((n + 1) * sizeof(int));
+	for (n = 0, k = 0; k < f->ninstr; k++) {
+		f->first[k] = n;
+		if (!ENDS_BLOCK(c[f->pos[k]].code) && k + 1 < f->ninstr) {
+			f->succ[n++] = k + 1;
+		}
+		for (j = f->pos[k] + 1; j < b->ip && (c[j].type & CODE_OPERAND); j++) {
+			if (IS_TARGET(c[j]) && c[j].label >= minl && c[j].label <= maxl
+					&& at[c[j].label - minl] < f->ninstr) {
+				f->succ[n++] = at[c[j].label - minl];
+			}
+		}
+	}
+	f->first[k] = n;
+
+	free(at);
+}
+
+/**
+ * Releases the memory held by a control flow graph.
+ *
+ * @param[in] f the control flow graph.
+ */
+static void release_flow(Flow *f)
+{
+	free(f->pos);
+	free(f->first);
+	free(f->succ);
+}
+
+/**
+ * Computes the local variables used and defined by every instruction of a
+ * method body, and, by iterating backwards to a fixed point, the variables
+ * live before and after every instruction.  The sets of an instruction are
+ * found at index <code>k * l->nw</code> of the respective arrays, where
+ * <code>k</code> is the instruction index in the control flow graph.
+ *
+ * @param[in]  b the method body.
+ * @param[in]  f the control flow graph of the body.
+ * @param[out] l the liveness information, which must be released even if the
+ *               computation fails.
+ * @return     <code>FALSE</code> if some slot is accessed as both an integer
+ *             and a reference, in which case the live sets are not computed,
+ *             or <code>TRUE</code> otherwise.
+ */
+static Boolean compute_liveness(Body *b, Flow *f, Liveness *l)
+{
+	Code *c = b->code;
+	int nw, k, s, v, w;
+	Kind kd;
+	Boolean changed, uses, defines;
+
+	l->nvars = b->variables_width;
+	l->nw = nw = NWORDS(l->nvars);
+	l->use = new_sets(f->ninstr, l->nvars);
+	l->def = new_sets(f->ninstr, l->nvars);
+	l->in = l->out = NULL;
+
+	/* parameters have fixed kinds; main has its argument array */
+	l->kind = emalloc(l->nvars * sizeof(Kind));
+	for (v = 0; v < l->nvars; v++) {
+		l->kind[v] = KIND_NONE;
+	}
+	if (strcmp(b->name, "main") == 0) {
+		l->kind[0] = KIND_REF;
+	} else {
+		for (v = 0; v < (int) b->idprop->nparams; v++) {
+			l->kind[v] = IS_ARRAY(b->idprop->params[v]) ? KIND_REF : KIND_INT;
+		}
+	}
+
+	for (k = 0; k < f->ninstr; k++) {
+		if ((kd = local_access(&c[f->pos[k]], &uses, &defines)) == KIND_NONE) {
+			continue;
+		}
+		v = c[f->pos[k] + 1].num;
+		if (l->kind[v] != KIND_NONE && l->kind[v] != kd) {
+			return FALSE;
+		}
+		l->kind[v] = kd;
+		if (uses) {
+			SET_BIT(&l->use[k * nw], v);
+		}
+		if (defines) {
+			SET_BIT(&l->def[k * nw], v);
+		}
+	}
+
+	l->in = new_sets(f->ninstr, l->nvars);
+	l->out = new_sets(f->ninstr, l->nvars);
+	do {
+		changed = FALSE;
+		for (k = f->ninstr - 1; k >= 0; k--) {
+			for (s = f->first[k]; s < f->first[k + 1]; s++) {
+				for (w = 0; w < nw; w++) {
+					l->out[k * nw + w] |= l->in[f->succ[s] * nw + w];
+				}
+			}
+			for (w = 0; w < nw; w++) {
+				Word n = l->use[k * nw + w]
+					| (l->out[k * nw + w] & ~l->def[k * nw + w]);
+				if (n != l->in[k * nw + w]) {
+					l->in[k * nw + w] = n;
+					changed = TRUE;
+				}
+			}
+		}
+	} while (changed);
+
+	return TRUE;
+}
+
+/**
+ * Releases the memory held by liveness information.
+ *
+ * @param[in] l the liveness information.
+ */
+static void release_liveness(Liveness *l)
+{
+	free(l->kind);
+	free(l->use);
+	free(l->def);
+	free(l->in);
+	free(l->out);
+}
+
+/**
+ * Moves the statements between two marks of a method body into a new method,
+ * and generates the code to call it into the code of the caller.  The local
+ * variables that the statements read before writing them are packed into the
+ * carrier arrays before the call, and unpacked into the slots of the new
+ * method, which are those of the caller moved up by the number of carriers.
+ * Variables written by the statements that are live afterwards are passed
+ * back the same way.
+ *
+ * @param[in]     b          the method body.
+ * @param[in]     f          the control flow graph of the body.
+ * @param[in]     l          the liveness information of the body.
+ * @param[in]     elem       the element type of every array slot.
+ * @param[in]     from       the code position of the first mark.
+ * @param[in]     to         the code position of the last mark.
+ * @param[in]     nparts     the number of parts split off so far.
+ * @param[in]     class_name the class name.
+ * @param[in,out] caller     the code of the caller.
+ * @return        the body of the new method.
+ */
+static Body *make_part(Body *b, Flow *f, Liveness *l, ValType *elem,
+		int from, int to, int nparts, const char *class_name, Buffer *caller)
+{
+	Body *part;
+	Buffer code;
+	Code *c = b->code;
+	Word *refd, *defd, *pass, *back;
+	int first, last, base, nw = l->nw, i, k, v, w, *carrier, *index,
+		count[NCARRIERS] = { 0 };
+	Boolean uses, defines;
+	char *ref;
+
+	/* the variables read on entry, and those written and live afterwards */
+	first = instruction_at(f, from);
+	last = instruction_at(f, to);
+	refd = new_sets(1, l->nvars);
+	defd = new_sets(1, l->nvars);
+	pass = new_sets(1, l->nvars);
+	back = new_sets(1, l->nvars);
+	for (k = first; k < last; k++) {
+		for (w = 0; w < nw; w++) {
+			refd[w] |= l->use[k * nw + w] | l->def[k * nw + w];
+			defd[w] |= l->def[k * nw + w];
+		}
+	}
+	for (w = 0; w < nw; w++) {
+		if (first < f->ninstr) {
+			pass[w] = refd[w] & l->in[first * nw + w];
+		}
+		if (last < f->ninstr) {
+			back[w] = defd[w] & l->in[last * nw + w];
+		}
+	}
+
+	/* the carrier and index of every variable passed either way */
+	carrier = emalloc(l->nvars * sizeof(int));
+	index = emalloc(l->nvars * sizeof(int));
+	for (v = 0; v < l->nvars; v++) {
+		if (HAS_BIT(pass, v) || HAS_BIT(back, v)) {
+			carrier[v] = (l->kind[v] == KIND_INT ? 0
+					: IS_BOOLEAN_TYPE(elem[v]) ? 2 : 1);
+			index[v] = count[carrier[v]]++;
+		}
+	}
+
+	part = emalloc(sizeof(Body));
+	part->name = emalloc(strlen(b->name) + 16);
+	sprintf(part->name, "%s$part%d", b->name, nparts);
+	part->signature = estrdup(PART_SIGNATURE);
+	part->idprop = emalloc(sizeof(IDprop));
+	part->idprop->type = TYPE_CALLABLE;
+	part->idprop->offset = 0;
+	part->idprop->nparams = NCARRIERS;
+	part->idprop->params = emalloc(NCARRIERS * sizeof(ValType));
+	part->idprop->params[0] = TYPE_ARRAY | TYPE_INTEGER;
+	part->idprop->params[1] = TYPE_ARRAY | TYPE_INTEGER;
+	part->idprop->params[2] = TYPE_ARRAY | TYPE_BOOLEAN;
+	part->variables_width = l->nvars + NCARRIERS;
+	part->vars = NULL;
+	part->nvars = 0;
+	part->pure = FALSE;
+	part->loop = -1;
+	part->next = NULL;
+
+	/* in the caller: fill the carriers, call, and empty them */
+	base = l->nvars;
+	for (i = 0; i < NCARRIERS; i++) {
+		emit(caller, CODE_INSTRUCTION, JVM_LDC);
+		emit(caller, CODE_OPERAND | CODE_INTEGER, count[i]);
+		if (i == 0) {
+			emit(caller, CODE_INSTRUCTION, JVM_NEWARRAY);
+			emit(caller, CODE_OPERAND | CODE_ARRAY_TYPE, T_INT);
+		} else {
+			emit_ref(caller, JVM_ANEWARRAY, (i == 1 ? "[I" : "[Z"));
+		}
+		emit(caller, CODE_INSTRUCTION, JVM_ASTORE);
+		emit(caller, CODE_OPERAND | CODE_INTEGER, base + i);
+	}
+	for (v = 0; v < l->nvars; v++) {
+		if (HAS_BIT(pass, v)) {
+			emit(caller, CODE_INSTRUCTION, JVM_ALOAD);
+			emit(caller, CODE_OPERAND | CODE_INTEGER, base + carrier[v]);
+			emit(caller, CODE_INSTRUCTION, JVM_LDC);
+			emit(caller, CODE_OPERAND | CODE_INTEGER, index[v]);
+			emit(caller, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_ILOAD : JVM_ALOAD));
+			emit(caller, CODE_OPERAND | CODE_INTEGER, v);
+			emit(caller, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_IASTORE : JVM_AASTORE));
+		}
+	}
+	for (i = 0; i < NCARRIERS; i++) {
+		emit(caller, CODE_INSTRUCTION, JVM_ALOAD);
+		emit(caller, CODE_OPERAND | CODE_INTEGER, base + i);
+	}
+	ref = emalloc(strlen(class_name) + strlen(part->name)
+			+ strlen(PART_SIGNATURE) + 2);
+	sprintf(ref, "%s/%s%s", class_name, part->name, PART_SIGNATURE);
+	emit_ref(caller, JVM_INVOKESTATIC, ref);
+	caller->code[caller->ip - 1].type |= CODE_ALLOCATED;
+	for (v = 0; v < l->nvars; v++) {
+		if (HAS_BIT(back, v)) {
+			emit(caller, CODE_INSTRUCTION, JVM_ALOAD);
+			emit(caller, CODE_OPERAND | CODE_INTEGER, base + carrier[v]);
+			emit(caller, CODE_INSTRUCTION, JVM_LDC);
+			emit(caller, CODE_OPERAND | CODE_INTEGER, index[v]);
+			emit(caller, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_IALOAD : JVM_AALOAD));
+			emit(caller, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_ISTORE : JVM_ASTORE));
+			emit(caller, CODE_OPERAND | CODE_INTEGER, v);
+		}
+	}
+
+	/* in the part: unpack, run the statements, and pack */
+	code.size = to - from + 16;
+	code.code = emalloc(code.size * sizeof(Code));
+	code.ip = 0;
+	for (v = 0; v < l->nvars; v++) {
+		if (HAS_BIT(pass, v)) {
+			emit(&code, CODE_INSTRUCTION, JVM_ALOAD);
+			emit(&code, CODE_OPERAND | CODE_INTEGER, carrier[v]);
+			emit(&code, CODE_INSTRUCTION, JVM_LDC);
+			emit(&code, CODE_OPERAND | CODE_INTEGER, index[v]);
+			emit(&code, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_IALOAD : JVM_AALOAD));
+			emit(&code, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_ISTORE : JVM_ASTORE));
+			emit(&code, CODE_OPERAND | CODE_INTEGER, v + NCARRIERS);
+		}
+	}
+	for (i = from; i < to; i++) {
+		if (c[i].type == CODE_MARK) {
+			continue;
+		}
+		emit(&code, c[i].type, 0);
+		code.code[code.ip - 1] = c[i];
+		if (c[i].type == CODE_INSTRUCTION
+				&& local_access(&c[i], &uses, &defines) != KIND_NONE) {
+			emit(&code, c[i + 1].type, c[i + 1].num + NCARRIERS);
+			i++;
+		}
+	}
+	for (v = 0; v < l->nvars; v++) {
+		if (HAS_BIT(back, v)) {
+			emit(&code, CODE_INSTRUCTION, JVM_ALOAD);
+			emit(&code, CODE_OPERAND | CODE_INTEGER, carrier[v]);
+			emit(&code, CODE_INSTRUCTION, JVM_LDC);
+			emit(&code, CODE_OPERAND | CODE_INTEGER, index[v]);
+			emit(&code, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_ILOAD : JVM_ALOAD));
+			emit(&code, CODE_OPERAND | CODE_INTEGER, v + NCARRIERS);
+			emit(&code, CODE_INSTRUCTION,
+					(carrier[v] == 0 ? JVM_IASTORE : JVM_AASTORE));
+		}
+	}
+	emit(&code, CODE_INSTRUCTION, JVM_RETURN);
+	part->code = code.code;
+	part->ip = code.ip;
+
+	free(refd);
+	free(defd);
+	free(pass);
+	free(back);
+	free(carrier);
+	free(index);
+
+	return part;
+}
+
+/**
+ * Determines the element type of every array held in a local variable slot,
+ * from the parameter types, and from the allocation, invocation, or load that
+ * precedes each store to the slot.  A slot that is never stored to holds a
+ * null reference, and is taken to be an integer array.
+ *
+ * @param[in]  b    the method body.
+ * @param[in]  f    the control flow graph of the body.
+ * @param[out] elem the element type of every slot.
+ */
+static void infer_elements(Body *b, Flow *f, ValType *elem)
+{
+	Code *c = b->code, *p;
+	int k, v;
+	const char *d;
+	Boolean changed;
+
+	for (v = 0; v < b->variables_width; v++) {
+		elem[v] = TYPE_NONE;
+	}
+	if (strcmp(b->name, "main") != 0) {
+		for (v = 0; v < (int) b->idprop->nparams; v++) {
+			elem[v] = b->idprop->params[v] & ~TYPE_ARRAY;
+		}
+	}
+
+	do {
+		changed = FALSE;
+		for (k = 1; k < f->ninstr; k++) {
+			if (!IS_INSTRUCTION(c[f->pos[k]], JVM_ASTORE)
+					|| elem[v = c[f->pos[k] + 1].num] != TYPE_NONE) {
+				continue;
+			}
+			p = &c[f->pos[k - 1]];
+			if (p->code == JVM_NEWARRAY) {
+				elem[v] = (p[1].atype == T_BOOLEAN ? TYPE_BOOLEAN
+						: TYPE_INTEGER);
+			} else if (p->code == JVM_INVOKESTATIC
+					&& (d = strrchr(p[1].string, ')')) != NULL
+					&& d[1] == '[') {
+				elem[v] = (d[2] == 'Z' ? TYPE_BOOLEAN : TYPE_INTEGER);
+			} else if (p->code == JVM_ALOAD) {
+				elem[v] = elem[p[1].num];
+			}
+			changed = changed || elem[v] != TYPE_NONE;
+		}
+	} while (changed);
+
+	for (v = 0; v < b->variables_width; v++) {
+		if (elem[v] == TYPE_NONE) {
+			elem[v] = TYPE_INTEGER;
+		}
+	}
+}
+
+/**
+ * Computes the size in bytes of the bytecode assembled from the code in
+ * positions <code>from</code> up to, but not including, <code>to</code>.  Where
+ * the assembler may choose between encodings, the longer one is counted.
+ *
+ * @param[in] c    the code.
+ * @param[in] from the first position to consider.
+ * @param[in] to   the position after the last one to consider.
+ * @return    the size of the code.
+ */
+static int code_length(Code *c, int from, int to)
+{
+	int i, n = 0;
+
+	for (i = from; i < to; i++) {
+		if (c[i].type != CODE_INSTRUCTION) {
+			continue;
+		}
+		switch (c[i].code) {
+			case JVM_ALOAD:
+			case JVM_ASTORE:
+			case JVM_ILOAD:
+			case JVM_ISTORE:
+				n += (c[i + 1].num < 256 ? 2 : 4);
+				break;
+			case JVM_IINC:
+				n += (c[i + 1].num < 256 && c[i + 2].num >= -128
+						&& c[i + 2].num <= 127 ? 3 : 6);
+				break;
+			case JVM_NEWARRAY:
+				n += 2;
+				break;
+			case JVM_LOOKUPSWITCH:
+				n += 12 + 8 * c[i + 1].num;
+				break;
+			case JVM_TABLESWITCH:
+				n += 16 + 4 * (c[i + 2].num - c[i + 1].num + 1);
+				break;
+			case JVM_ANEWARRAY:
+			case JVM_GETSTATIC:
+			case JVM_GOTO:
+			case JVM_IFEQ:
+			case JVM_IFNE:
+			case JVM_IF_ICMPEQ:
+			case JVM_IF_ICMPGE:
+			case JVM_IF_ICMPGT:
+			case JVM_IF_ICMPLE:
+			case JVM_IF_ICMPLT:
+			case JVM_IF_ICMPNE:
+			case JVM_INVOKESTATIC:
+			case JVM_INVOKEVIRTUAL:
+			case JVM_LDC:
+				n += 3;
+				break;
+			default:
+				n += 1;
+				break;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * Returns whether the code in positions <code>from</code> up to, but not
+ * including, <code>to</code> returns from the method.
+ *
+ * @param[in] c    the code.
+ * @param[in] from the first position to check.
+ * @param[in] to   the position after the last one to check.
+ * @return    <code>TRUE</code> if the code contains a return instruction, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean returns(Code *c, int from, int to)
+{
+	int i;
+
+	for (i = from; i < to; i++) {
+		if (IS_INSTRUCTION(c[i], JVM_ARETURN)
+				|| IS_INSTRUCTION(c[i], JVM_IRETURN)
+				|| IS_INSTRUCTION(c[i], JVM_RETURN)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Returns the index of the first instruction at or after a code position.
+ *
+ * @param[in] f   the control flow graph.
+ * @param[in] pos the code position.
+ * @return    the instruction index, which is the number of instructions if
+ *            there is none at or after the position.
+ */
+static int instruction_at(Flow *f, int pos)
+{
+	int lo = 0, hi = f->ninstr, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (f->pos[mid] < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Appends an entry to a code array, growing it as necessary.  The number is
+ * stored as the opcode, the integer, or the array type, depending on the type
+ * of the entry.
+ *
+ * @param[in,out] buf  the code array.
+ * @param[in]     type the type of the entry.
+ * @param[in]     num  the opcode, integer, or array type.
+ */
+static void emit(Buffer *buf, CodeType type, int num)
+{
+	if (buf->ip == buf->size) {
+		buf->size *= 2;
+		buf->code = erealloc(buf->code, buf->size * sizeof(Code));
+	}
+	buf->code[buf->ip].type = type;
+	if (type == CODE_INSTRUCTION) {
+		buf->code[buf->ip].code = num;
+	} else if (type == (CODE_OPERAND | CODE_ARRAY_TYPE)) {
+		buf->code[buf->ip].atype = num;
+	} else {
+		buf->code[buf->ip].num = num;
+	}
+	buf->ip++;
+}
+
+/**
+ * Appends an instruction with a reference operand to a code array.
+ *
+ * @param[in,out] buf    the code array.
+ * @param[in]     opcode the instruction.
+ * @param[in]     ref    the reference, which is not copied.
+ */
+static void emit_ref(Buffer *buf, Bytecode opcode, char *ref)
+{
+	emit(buf, CODE_INSTRUCTION, opcode);
+	emit(buf, CODE_OPERAND | CODE_REFERENCE, 0);
+	buf->code[buf->ip - 1].string = ref;
+}
+
+/**
+ * Determines how an instruction accesses a local variable, if it does.  The
+ * variable is the operand following the instruction.
+ *
+ * @param[in]  c       the instruction.
+ * @param[out] uses    whether the instruction reads the variable.
+ * @param[out] defines whether the instruction writes the variable.
+ * @return     the kind of value in the variable, or <code>KIND_NONE</code> if
+ *             the instruction does not access a local variable.
+ */
+static Kind local_access(Code *c, Boolean *uses, Boolean *defines)
+{
+	*uses = *defines = FALSE;
+	switch (c->code) {
+		case JVM_ALOAD:
+			*uses = TRUE;
+			return KIND_REF;
+		case JVM_ASTORE:
+			*defines = TRUE;
+			return KIND_REF;
+		case JVM_IINC:
+			*uses = *defines = TRUE;
+			return KIND_INT;
+		case JVM_ILOAD:
+			*uses = TRUE;
+			return KIND_INT;
+		case JVM_ISTORE:
+			*defines = TRUE;
+			return KIND_INT;
+		default:
+			return KIND_NONE;
+	}
+}
+
+/**
+ * Allocates an array of empty bit sets, each of which starts on a word
+ * boundary.
+ *
+ * @param[in] nsets the number of sets.
+ * @param[in] nbits the number of bits in every set.
+ * @return    the new sets, with all bits clear.
+ */
+static Word *new_sets(int nsets, int nbits)
+{
+	Word *s;
+	size_t n = (nsets > 0 ? nsets : 1) * NWORDS(nbits > 0 ? nbits : 1)
+		* sizeof(Word);
+
+	s = emalloc(n);
+	memset(s, 0, n);
+	return s;
+}
+
+/**
+ * Adds a stretch of statements to those in which a variable is live, joining
+ * it to the last one if they meet.
+ *
+ * @param[in,out] v    the variable.
+ * @param[in,out] size the number of stretches allocated for the variable.
+ * @param[in]     from the line entry at which the stretch starts, or -1.
+ * @param[in]     to   the line entry at which the stretch ends.
+ */
+static void add_span(LocalVar *v, int *size, int from, int to)
+{
+	LiveRange *last = (v->nspans > 0 ? &v->spans[v->nspans - 1] : NULL);
+
+	if (last != NULL && from <= last->to) {
+		last->to = HIGHER(last->to, to);
+		return;
+	}
+	if (v->nspans == *size) {
+		*size *= 2;
+		v->spans = erealloc(v->spans, *size * sizeof(LiveRange));
+	}
+	v->spans[v->nspans].from = from;
+	v->spans[v->nspans++].to = to;
+}
+
+/**
+ * Keeps the stretches of the variables that share a slot apart.  Two such
+ * variables are never live at the same instruction, but may be in the same
+ * statement, where one goes out of use and the other comes into it; the
+ * statement is left to the one that goes out of use.  Stretches left empty
+ * are dropped, and those that run to the last line entry are made to run to
+ * the end of the method.
+ *
+ * @param[in,out] b      the method body, whose variables are in their slots.
+ * @param[in]     nlines the number of line entries in the body.
+ */
+static void separate_spans(Body *b, int nlines)
+{
+	SlotSpan *all;
+	LiveRange *s;
+	LocalVar *v;
+	int i, j, n, end = -1;
+
+	for (i = 0, n = 0; i < b->nvars; i++) {
+		n += (b->vars[i].slot >= 0 ? b->vars[i].nspans : 0);
+	}
+	all = emalloc((n + 1) * sizeof(SlotSpan));
+	for (i = 0, n = 0; i < b->nvars; i++) {
+		for (j = 0; b->vars[i].slot >= 0 && j < b->vars[i].nspans; j++) {
+			all[n].span = &b->vars[i].spans[j];
+			all[n++].slot = b->vars[i].slot;
+		}
+	}
+	qsort(all, n, sizeof(SlotSpan), compare_spans);
+	for (i = 0; i < n; i++) {
+		s = all[i].span;
+		if (i == 0 || all[i].slot != all[i - 1].slot) {
+			end = -1;
+		}
+		if (s->to <= end) {
+			s->to = s->from;
+		} else {
+			s->from = HIGHER(s->from, end);
+			end = s->to;
+		}
+	}
+	free(all);
+
+	for (i = 0; i < b->nvars; i++) {
+		v = &b->vars[i];
+		if (v->slot < 0) {
+			continue;
+		}
+		for (j = 0, n = 0; j < v->nspans; j++) {
+			if (v->spans[j].from < v->spans[j].to) {
+				v->spans[n].from = v->spans[j].from;
+				v->spans[n++].to = (v->spans[j].to < nlines ? v->spans[j].to
+						: -1);
+			}
+		}
+		v->nspans = n;
+	}
+}
+
+/**
+ * Compares two stretches by slot, then by where they start, then by where
+ * they end.
+ *
+ * @param[in] a the first stretch.
+ * @param[in] b the second stretch.
+ * @return    a negative value, zero, or a positive value if the first stretch
+ *            comes before, with, or after the second.
+ */
+static int compare_spans(const void *a, const void *b)
+{
+	const SlotSpan *x = a, *y = b;
+
+	if (x->slot != y->slot) {
+		return x->slot - y->slot;
+	}
+	if (x->span->from != y->span->from) {
+		return x->span->from - y->span->from;
+	}
+	return x->span->to - y->span->to;
+}
+
+/**
+ * Determines whether a method body has an effect, other than through the
+ * methods it calls, that can be seen outside it.  Output goes through the
+ * static field for the standard output stream, and input through calls to
+ * methods that have no body in the list; stores into arrays are only seen
+ * outside if the array is a parameter, and are therefore only allowed if
+ * there are no array parameters.
+ *
+ * @param[in] b the method body.
+ * @return    <code>TRUE</code> if the body has an effect, or
+ *            <code>FALSE</code> otherwise.
+ */
+static Boolean has_effects(Body *b)
+{
+	Boolean array_params = FALSE;
+	unsigned int k;
+	int i;
+
+	for (k = 0; k < b->idprop->nparams; k++) {
+		if (IS_ARRAY_TYPE(b->idprop->params[k])) {
+			array_params = TRUE;
+		}
+	}
+
+	for (i = 0; i < b->ip; i++) {
+		if (b->code[i].type != CODE_INSTRUCTION) {
+			continue;
+		}
+		switch (b->code[i].code) {
+			case JVM_GETSTATIC:
+			case JVM_INVOKEVIRTUAL:
+				return TRUE;
+			case JVM_AASTORE:
+			case JVM_BASTORE:
+			case JVM_IASTORE:
+				if (array_params) {
+					return TRUE;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Finds the body of the method to which an invocation refers.
+ *
+ * @param[in] bodies     the list of method bodies.
+ * @param[in] ref        the method reference of the invocation, in the form
+ *                       <code>class/name(descriptor)</code>.
+ * @param[in] class_name the name of the class.
+ * @return    the body of the method, or <code>NULL</code> if the method is
+ *            not in the list.
+ */
+static Body *find_callee(Body *bodies, const char *ref, const char *class_name)
+{
+	size_t n = strlen(class_name);
+	const char *name, *end;
+	Body *b;
+
+	if (strncmp(ref, class_name, n) != 0 || ref[n] != '/') {
+		return NULL;
+	}
+	name = ref + n + 1;
+	end = strchr(name, '(');
+
+	for (b = bodies; b != NULL; b = b->next) {
+		if (strlen(b->name) == (size_t) (end - name)
+				&& strncmp(b->name, name, end - name) == 0) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Checks whether an invocation is a probe of the profile.
+ *
+ * @param[in] ref        the method reference of the invocation.
+ * @param[in] class_name the name of the class.
+ * @return    <code>TRUE</code> if the invocation counts a run of a place in
+ *            the program, or <code>FALSE</code> otherwise.
+ */
+static Boolean is_probe(const char *ref, const char *class_name)
+{
+	size_t n = strlen(class_name);
+
+	return strncmp(ref, class_name, n) == 0
+		&& strcmp(ref + n, PROBE_METHOD) == 0;
+}
+
+/**
+ * Returns the position of a body in the list of bodies.
+ *
+ * @param[in] bodies the list of method bodies.
+ * @param[in] b      the body, which must be in the list.
+ * @return    the number of bodies before <code>b</code>.
+ */
+static int body_index(Body *bodies, Body *b)
+{
+	int i;
+
+	for (i = 0; bodies != b; bodies = bodies->next) {
+		i++;
+	}
+	return i;
+}
+
+/**
+ * Replaces a comparison whose result is only tested by a conditional jump
+ * with a single conditional jump.  A comparison pushes zero or one by way of
+ * two labels, which is tested at once by <code>ifeq</code> or
+ * <code>ifne</code>; if nothing else jumps to the labels, the comparison may
+ * jump straight to the target of the test, under the opposite condition for
+ * <code>ifeq</code>, and the same one for <code>ifne</code>.  Besides being shorter, the jump then
+ * tells the range analysis how its operands compare on either edge.
+ *
+ * @param[in,out] b the method body.
+ */
+static void thread_comparisons(Body *b)
+{
+	Code *c = b->code;
+	Label minl = (Label) -1, maxl = 0, l1, l2;
+	Bytecode test;
+	int *refs, i, n;
+
+	for (i = 0; i < b->ip; i++) {
+		if (IS_TARGET(c[i])) {
+			if (c[i].label < minl) {
+				minl = c[i].label;
+			}
+			if (c[i].label > maxl) {
+				maxl = c[i].label;
+			}
+		}
+	}
+	if (minl > maxl) {
+		return;
+	}
+	refs = emalloc((maxl - minl + 1) * sizeof(int));
+	memset(refs, 0, (maxl - minl + 1) * sizeof(int));
+	for (i = 0; i < b->ip; i++) {
+		if (IS_TARGET(c[i])) {
+			refs[c[i].label - minl]++;
+		}
+	}
+
+	/* if_icmpXX L1; ldc 0; goto L2; L1: ldc 1; L2: ifeq X (or ifne X) */
+	n = 0;
+	i = 0;
+	while (i < b->ip) {
+		if (i + 12 <= b->ip
+				&& c[i].type == CODE_INSTRUCTION && c[i].code != JVM_IFEQ
+				&& c[i].code != JVM_IFNE
+				&& is_conditional(c[i].code)
+				&& IS_INSTRUCTION(c[i + 2], JVM_LDC)
+				&& c[i + 3].type == (CODE_OPERAND | CODE_INTEGER)
+				&& c[i + 3].num == 0
+				&& IS_INSTRUCTION(c[i + 4], JVM_GOTO)
+				&& c[i + 6].type == CODE_LABEL
+				&& c[i + 6].label == c[i + 1].label
+				&& IS_INSTRUCTION(c[i + 7], JVM_LDC)
+				&& c[i + 8].type == (CODE_OPERAND | CODE_INTEGER)
+				&& c[i + 8].num == 1
+				&& c[i + 9].type == CODE_LABEL
+				&& c[i + 9].label == c[i + 5].label
+				&& (IS_INSTRUCTION(c[i + 10], JVM_IFEQ)
+					|| IS_INSTRUCTION(c[i + 10], JVM_IFNE))) {
+			l1 = c[i + 1].label;
+			l2 = c[i + 5].label;
+			if (refs[l1 - minl] == 1 && refs[l2 - minl] == 1) {
+				test = (c[i + 10].code == JVM_IFEQ ? negate(c[i].code)
+						: c[i].code);
+				c[n].type = CODE_INSTRUCTION;
+				c[n++].code = test;
+				c[n++] = c[i + 11];
+				i += 12;
+				continue;
+			}
+		}
+		c[n++] = c[i++];
+	}
+	b->ip = n;
+
+	free(refs);
+}
+
+/**
+ * Computes, by iterating forwards to a fixed point, the range of every local
+ * variable and stack entry each time an instruction is reached, and which
+ * instructions are reached at all.  Along either edge of a conditional jump,
+ * the ranges of the variables it tests are narrowed to those for which the
+ * test comes out that way, and an edge along which it cannot is not followed.
+ * A switch on a constant takes only its one case.  A range that keeps growing
+ * where paths meet is widened to the limits of an integer, so that loops
+ * settle quickly.
+ *
+ * @param[in]  b      the method body.
+ * @param[in]  f      the control flow graph of the body.
+ * @param[in]  params the values of the parameters on entry.
+ * @param[out] k      the ranges, which must be released even if the
+ *                    computation fails.
+ * @return     <code>FALSE</code> if the stack depths do not agree where
+ *             paths meet, or if the ranges would take more than
+ *             <code>RANGES_LIMIT</code> values, or <code>TRUE</code>
+ *             otherwise.
+ */
+static Boolean compute_ranges(Body *b, Flow *f, Value *params, Ranges *k)
+{
+	Code *c = b->code;
+	Value *in, *sp, *out, *edge;
+	Label maxl = 0, target;
+	int i, s, v, depth, to;
+	Boolean changed, ok = TRUE;
+
+	k->nvars = b->variables_width;
+	k->width = k->nvars + b->max_stack_depth;
+	if ((size_t) f->ninstr * k->width > RANGES_LIMIT) {
+		k->depth = k->grown = k->at = NULL;
+		k->value = NULL;
+		return FALSE;
+	}
+	k->depth = emalloc((f->ninstr + 1) * sizeof(int));
+	k->grown = emalloc((f->ninstr + 1) * sizeof(int));
+	k->value = emalloc(((size_t) f->ninstr * k->width + 1) * sizeof(Value));
+	for (i = 0; i < f->ninstr; i++) {
+		k->depth[i] = -1;
+		k->grown[i] = 0;
+	}
+
+	/* the instruction at every label */
+	k->minl = (Label) -1;
+	for (i = 0; i < b->ip; i++) {
+		if (c[i].type == CODE_LABEL) {
+			if (c[i].label < k->minl) {
+				k->minl = c[i].label;
+			}
+			if (c[i].label > maxl) {
+				maxl = c[i].label;
+			}
+		}
+	}
+	k->nat = (k->minl > maxl ? 0 : (int) (maxl - k->minl + 1));
+	k->at = emalloc((k->nat + 1) * sizeof(int));
+	for (i = 0; i < k->nat; i++) {
+		k->at[i] = f->ninstr;
+	}
+	for (i = 0; i < b->ip; i++) {
+		if (c[i].type == CODE_LABEL) {
+			k->at[c[i].label - k->minl] = instruction_at(f, i);
+		}
+	}
+
+	if (f->ninstr == 0) {
+		return TRUE;
+	}
+
+	/* on entry, only parameters may be known */
+	k->depth[0] = 0;
+	for (v = 0; v < k->nvars; v++) {
+		k->value[v] = varying();
+		if (v < (int) b->idprop->nparams && strcmp(b->name, "main") != 0) {
+			k->value[v] = params[v];
+		}
+	}
+
+	out = emalloc((k->width + 1) * sizeof(Value));
+	edge = emalloc((k->width + 1) * sizeof(Value));
+	do {
+		changed = FALSE;
+		for (i = 0; ok && i < f->ninstr; i++) {
+			if (k->depth[i] < 0) {
+				continue;
+			}
+			in = &k->value[(size_t) i * k->width];
+			sp = &in[k->nvars + k->depth[i]];
+			if (!transfer(&c[f->pos[i]], in, k->depth[i], k, out, &depth)) {
+				ok = FALSE;
+			} else if (is_conditional(c[f->pos[i]].code)) {
+				/* the jump, then the fall-through */
+				for (s = 0; ok && s < 2; s++) {
+					memcpy(edge, out, (k->nvars + depth) * sizeof(Value));
+					to = (s == 0 ? k->at[c[f->pos[i] + 1].label - k->minl]
+							: i + 1);
+					if (refine(&c[f->pos[i]], sp, edge, s == 0)
+							&& to < f->ninstr) {
+						ok = merge_values(k, i, to, edge, depth, &changed);
+					}
+				}
+			} else if (decide_switch(&c[f->pos[i]], sp, &target)) {
+				to = k->at[target - k->minl];
+				if (to < f->ninstr) {
+					ok = merge_values(k, i, to, out, depth, &changed);
+				}
+			} else {
+				for (s = f->first[i]; ok && s < f->first[i + 1]; s++) {
+					ok = merge_values(k, i, f->succ[s], out, depth,
+							&changed);
+				}
+			}
+		}
+	} while (ok && changed);
+	free(edge);
+	free(out);
+
+	return ok;
+}
+
+/**
+ * Releases the memory held by the ranges of a method body.
+ *
+ * @param[in] k the ranges.
+ */
+static void release_ranges(Ranges *k)
+{
+	free(k->depth);
+	free(k->grown);
+	free(k->value);
+	free(k->at);
+}
+
+/**
+ * Computes the values after an instruction from the values before it.
+ *
+ * @param[in]  c         the instruction, followed by its operands.
+ * @param[in]  in        the values before the instruction.
+ * @param[in]  depth     the stack depth before the instruction.
+ * @param[in]  k         the ranges of the body, for their dimensions.
+ * @param[out] out       the values after the instruction.
+ * @param[out] out_depth the stack depth after the instruction.
+ * @return     <code>FALSE</code> if the stack would underflow or exceed its
+ *             recorded depth, or <code>TRUE</code> otherwise.
+ */
+static Boolean transfer(Code *c, Value *in, int depth, Ranges *k,
+		Value *out, int *out_depth)
+{
+	Value *sp, t;
+	int pop, push, v;
+
+	stack_effect(c, &pop, &push);
+	if (pop > depth || depth - pop + push > k->width - k->nvars) {
+		return FALSE;
+	}
+	memcpy(out, in, (k->nvars + depth) * sizeof(Value));
+	sp = &out[k->nvars + depth];
+
+	switch (c->code) {
+		case JVM_LDC:
+			*sp++ = (c[1].type == (CODE_OPERAND | CODE_INTEGER)
+					? constant(c[1].num) : varying());
+			break;
+		case JVM_ILOAD:
+			*sp = out[c[1].num];
+			sp->slot = c[1].num;
+			sp++;
+			break;
+		case JVM_ISTORE:
+			v = c[1].num;
+			out[v] = *--sp;
+			out[v].slot = -1;
+			forget_slot(&out[k->nvars], sp, v);
+			break;
+		case JVM_IINC:
+			v = c[1].num;
+			out[v] = (IS_CONSTANT(out[v])
+					? constant((int) ((unsigned int) out[v].lo + c[2].num))
+					: make_range((long long) out[v].lo + c[2].num,
+						(long long) out[v].hi + c[2].num));
+			forget_slot(&out[k->nvars], sp, v);
+			break;
+		case JVM_ASTORE:
+			v = c[1].num;
+			out[v] = varying();
+			sp--;
+			forget_slot(&out[k->nvars], sp, v);
+			break;
+		case JVM_IADD:
+		case JVM_IAND:
+		case JVM_IDIV:
+		case JVM_IMUL:
+		case JVM_IOR:
+		case JVM_IREM:
+		case JVM_ISHR:
+		case JVM_ISUB:
+		case JVM_IXOR:
+			sp -= 2;
+			sp[0] = arithmetic(c->code, &sp[0], &sp[1]);
+			sp++;
+			break;
+		case JVM_INEG:
+			sp[-1] = arithmetic(c->code, &sp[-1], NULL);
+			break;
+		case JVM_SWAP:
+			t = sp[-1];
+			sp[-1] = sp[-2];
+			sp[-2] = t;
+			break;
+		default:
+			sp -= pop;
+			while (push-- > 0) {
+				*sp++ = varying();
+			}
+			break;
+	}
+
+	*out_depth = sp - &out[k->nvars];
+	return TRUE;
+}
+
+/**
+ * Forgets that the stack entries in a range were loaded from a variable,
+ * which has just been assigned to.
+ *
+ * @param[in,out] from the first stack entry.
+ * @param[in]     to   the position just past the last stack entry.
+ * @param[in]     v    the variable.
+ */
+static void forget_slot(Value *from, Value *to, int v)
+{
+	for (; from < to; from++) {
+		if (from->slot == v) {
+			from->slot = -1;
+		}
+	}
+}
+
+/**
+ * Merges the values after an instruction into the values before one of its
+ * successors.  Every loop is entered again by a jump backwards; once the
+ * values before the target of such a jump have grown often enough, a range
+ * that grows again there is widened to the limits of an integer.
+ *
+ * @param[in,out] k       the ranges of the body.
+ * @param[in]     from    the index of the instruction.
+ * @param[in]     to      the index of the successor.
+ * @param[in]     out     the values after the instruction.
+ * @param[in]     depth   the stack depth after the instruction.
+ * @param[out]    changed set if the values before the successor changed.
+ * @return        <code>FALSE</code> if the stack depths do not agree, or
+ *                <code>TRUE</code> otherwise.
+ */
+static Boolean merge_values(Ranges *k, int from, int to, Value *out,
+		int depth, Boolean *changed)
+{
+	Value *in = &k->value[(size_t) to * k->width];
+	int v, lo, hi, slot;
+	Boolean grew = FALSE, widen = (to <= from && k->grown[to] >= WIDEN_AFTER);
+
+	if (k->depth[to] < 0) {
+		memcpy(in, out, (k->nvars + depth) * sizeof(Value));
+		k->depth[to] = depth;
+		*changed = TRUE;
+		return TRUE;
+	} else if (k->depth[to] != depth) {
+		return FALSE;
+	}
+
+	for (v = 0; v < k->nvars + depth; v++) {
+		lo = LOWER(in[v].lo, out[v].lo);
+		hi = HIGHER(in[v].hi, out[v].hi);
+		slot = (in[v].slot == out[v].slot ? in[v].slot : -1);
+		if (lo == in[v].lo && hi == in[v].hi && slot == in[v].slot) {
+			continue;
+		}
+		if (lo < in[v].lo || hi > in[v].hi) {
+			grew = TRUE;
+			if (widen) {
+				lo = (lo < in[v].lo ? INT_MIN : lo);
+				hi = (hi > in[v].hi ? INT_MAX : hi);
+			}
+		}
+		in[v].lo = lo;
+		in[v].hi = hi;
+		in[v].slot = slot;
+		*changed = TRUE;
+	}
+	if (grew) {
+		k->grown[to]++;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Returns a value that is known to be a constant.
+ *
+ * @param[in] num the constant.
+ * @return    the value.
+ */
+static Value constant(int num)
+{
+	Value r;
+
+	r.known = VALUE_RANGE;
+	r.lo = r.hi = num;
+	r.slot = -1;
+	return r;
+}
+
+/**
+ * Returns a value about which nothing is known.
+ *
+ * @return    the value.
+ */
+static Value varying(void)
+{
+	Value r;
+
+	r.known = VALUE_RANGE;
+	r.lo = INT_MIN;
+	r.hi = INT_MAX;
+	r.slot = -1;
+	return r;
+}
+
+/**
+ * Returns a value in a range computed without wrapping around.  If the range
+ * does not fit in an integer, the result may have wrapped around, and nothing
+ * is known about it.
+ *
+ * @param[in] lo the smallest value.
+ * @param[in] hi the largest value.
+ * @return    the value.
+ */
+static Value make_range(long long lo, long long hi)
+{
+	Value r;
+
+	if (lo < INT_MIN || hi > INT_MAX) {
+		return varying();
+	}
+	r.known = VALUE_RANGE;
+	r.lo = (int) lo;
+	r.hi = (int) hi;
+	r.slot = -1;
+	return r;
+}
+
+/**
+ * Computes the range of the result of an arithmetic or logical instruction
+ * from the ranges of its operands.  If the instruction fails at run time, it
+ * has no result, so the range need only hold for when it succeeds.
+ *
+ * @param[in] opcode the instruction.
+ * @param[in] a      the first operand.
+ * @param[in] b      the second operand, or <code>NULL</code> for negation.
+ * @return    the result.
+ */
+static Value arithmetic(Bytecode opcode, Value *a, Value *b)
+{
+	long long x0 = a->lo, x1 = a->hi, y0, y1, p[4], lo, hi, m;
+	int i;
+
+	if (IS_CONSTANT(*a) && (b == NULL || IS_CONSTANT(*b))) {
+		return combine(opcode, a, b);
+	} else if (b == NULL) {
+		return (opcode == JVM_INEG ? make_range(-x1, -x0) : varying());
+	}
+	y0 = b->lo;
+	y1 = b->hi;
+
+	switch (opcode) {
+		case JVM_IADD:
+			return make_range(x0 + y0, x1 + y1);
+		case JVM_ISUB:
+			return make_range(x0 - y1, x1 - y0);
+		case JVM_IMUL:
+		case JVM_IDIV:
+			if (opcode == JVM_IDIV && y0 <= 0 && y1 >= 0) {
+				/* the quotient is no further from zero than the dividend */
+				m = HIGHER(-x0, x1);
+				return make_range(-m, m);
+			}
+			/* both are monotonic in either operand of a fixed sign */
+			for (i = 0; i < 4; i++) {
+				p[i] = (opcode == JVM_IMUL
+						? (i < 2 ? x0 : x1) * (i % 2 ? y1 : y0)
+						: (i < 2 ? x0 : x1) / (i % 2 ? y1 : y0));
+			}
+			lo = LOWER(LOWER(p[0], p[1]), LOWER(p[2], p[3]));
+			hi = HIGHER(HIGHER(p[0], p[1]), HIGHER(p[2], p[3]));
+			return make_range(lo, hi);
+		case JVM_IREM:
+			/* the remainder has the sign of the dividend, and is smaller
+			 * than the divisor */
+			m = HIGHER(-y0, y1) - 1;
+			if (m < 0) {
+				return varying();
+			}
+			return make_range(x0 >= 0 ? 0 : HIGHER(x0, -m),
+					x1 <= 0 ? 0 : LOWER(x1, m));
+		case JVM_IAND:
+			if (x0 >= 0 && y0 >= 0) {
+				return make_range(0, LOWER(x1, y1));
+			} else if (x0 >= 0) {
+				return make_range(0, x1);
+			} else if (y0 >= 0) {
+				return make_range(0, y1);
+			}
+			return varying();
+		case JVM_IOR:
+		case JVM_IXOR:
+			if (x0 < 0 || y0 < 0) {
+				return varying();
+			}
+			/* no bits above the highest bit of either operand are set */
+			for (m = 0; m < HIGHER(x1, y1); m = 2 * m + 1)
+				;
+			return make_range(opcode == JVM_IOR ? HIGHER(x0, y0) : 0, m);
+		case JVM_ISHR:
+			if (y0 == y1) {
+				return make_range(shift_right(x0, y0 & 31),
+						shift_right(x1, y0 & 31));
+			}
+			return make_range(LOWER(x0, 0), HIGHER(x1, 0));
+		default:
+			return varying();
+	}
+}
+
+/**
+ * Computes the result of an arithmetic or logical instruction on constants.
+ * Division by zero is left to fail at run time.
+ *
+ * @param[in] opcode the instruction.
+ * @param[in] a      the first operand.
+ * @param[in] b      the second operand, or <code>NULL</code> for negation.
+ * @return    the result.
+ */
+static Value combine(Bytecode opcode, Value *a, Value *b)
+{
+	unsigned int x, y;
+
+	x = (unsigned int) a->lo;
+	y = (b != NULL ? (unsigned int) b->lo : 0);
+
+	/* wrap around on overflow, as the virtual machine does */
+	switch (opcode) {
+		case JVM_IADD:
+			return constant((int) (x + y));
+		case JVM_IAND:
+			return constant((int) (x & y));
+		case JVM_IDIV:
+			if (y == 0) {
+				return varying();
+			}
+			return constant(b->lo == -1 ? (int) (0u - x) : a->lo / b->lo);
+		case JVM_IMUL:
+			return constant((int) (x * y));
+		case JVM_INEG:
+			return constant((int) (0u - x));
+		case JVM_IOR:
+			return constant((int) (x | y));
+		case JVM_IREM:
+			if (y == 0) {
+				return varying();
+			}
+			return constant(b->lo == -1 ? 0 : a->lo % b->lo);
+		case JVM_ISHR:
+			return constant((int) shift_right(a->lo, (int) (y & 31)));
+		case JVM_ISUB:
+			return constant((int) (x - y));
+		case JVM_IXOR:
+			return constant((int) (x ^ y));
+		default:
+			return varying();
+	}
+}
+
+/**
+ * Shifts a number to the right, keeping its sign, as <code>ishr</code> does.
+ *
+ * @param[in] x the number.
+ * @param[in] s the number of bits to shift it by.
+ * @return    the shifted number.
+ */
+static long long shift_right(long long x, int s)
+{
+	return (x >= 0 ? x >> s : ~(~x >> s));
+}
+
+/**
+ * Determines whether an instruction is a conditional jump.
+ *
+ * @param[in] opcode the instruction.
+ * @return    <code>TRUE</code> if it is, or <code>FALSE</code> otherwise.
+ */
+static Boolean is_conditional(Bytecode opcode)
+{
+	switch (opcode) {
+		case JVM_IFEQ:
+		case JVM_IFNE:
+		case JVM_IF_ICMPEQ:
+		case JVM_IF_ICMPGE:
+		case JVM_IF_ICMPGT:
+		case JVM_IF_ICMPLE:
+		case JVM_IF_ICMPLT:
+		case JVM_IF_ICMPNE:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * Returns the integer comparison that holds exactly when another does not.
+ *
+ * @param[in] opcode the comparison.
+ * @return    the opposite comparison.
+ */
+static Bytecode negate(Bytecode opcode)
+{
+	switch (opcode) {
+		case JVM_IF_ICMPEQ:
+			return JVM_IF_ICMPNE;
+		case JVM_IF_ICMPGE:
+			return JVM_IF_ICMPLT;
+		case JVM_IF_ICMPGT:
+			return JVM_IF_ICMPLE;
+		case JVM_IF_ICMPLE:
+			return JVM_IF_ICMPGT;
+		case JVM_IF_ICMPLT:
+			return JVM_IF_ICMPGE;
+		default:
+			return JVM_IF_ICMPEQ;
+	}
+}
+
+/**
+ * Narrows the ranges of the operands of a conditional jump to those for which
+ * the jump is, or is not, taken.  The variables from which the operands were
+ * loaded are narrowed with them.
+ *
+ * @param[in]     c     the instruction, followed by its operands.
+ * @param[in]     sp    the position just above the top of the stack before
+ *                      the instruction.
+ * @param[in,out] state the local variables along the edge.
+ * @param[in]     holds whether the edge is the jump, rather than the
+ *                      fall-through.
+ * @return        <code>FALSE</code> if the jump cannot go that way, or
+ *                <code>TRUE</code> otherwise.
+ */
+static Boolean refine(Code *c, Value *sp, Value *state, Boolean holds)
+{
+	Value zero = constant(0), *a, *b;
+	Bytecode test;
+	long long alo, ahi, blo, bhi;
+
+	if (c->code == JVM_IFEQ || c->code == JVM_IFNE) {
+		a = &sp[-1];
+		b = &zero;
+		test = (c->code == JVM_IFEQ ? JVM_IF_ICMPEQ : JVM_IF_ICMPNE);
+	} else {
+		a = &sp[-2];
+		b = &sp[-1];
+		test = c->code;
+	}
+	if (!holds) {
+		test = negate(test);
+	}
+
+	alo = a->lo;
+	ahi = a->hi;
+	blo = b->lo;
+	bhi = b->hi;
+	switch (test) {
+		case JVM_IF_ICMPEQ:
+			alo = blo = HIGHER(alo, blo);
+			ahi = bhi = LOWER(ahi, bhi);
+			break;
+		case JVM_IF_ICMPNE:
+			if (blo == bhi) {
+				alo += (alo == blo);
+				ahi -= (ahi == blo);
+			}
+			if (alo == ahi) {
+				blo += (blo == alo);
+				bhi -= (bhi == alo);
+			}
+			break;
+		case JVM_IF_ICMPGE:
+			alo = HIGHER(alo, blo);
+			bhi = LOWER(bhi, ahi);
+			break;
+		case JVM_IF_ICMPGT:
+			alo = HIGHER(alo, blo + 1);
+			bhi = LOWER(bhi, ahi - 1);
+			break;
+		case JVM_IF_ICMPLE:
+			ahi = LOWER(ahi, bhi);
+			blo = HIGHER(blo, alo);
+			break;
+		case JVM_IF_ICMPLT:
+			ahi = LOWER(ahi, bhi - 1);
+			blo = HIGHER(blo, alo + 1);
+			break;
+		default:
+			break;
+	}
+
+	return alo <= ahi && blo <= bhi
+		&& narrow(state, a->slot, alo, ahi) && narrow(state, b->slot, blo, bhi);
+}
+
+/**
+ * Narrows the range of a local variable.
+ *
+ * @param[in,out] state the local variables.
+ * @param[in]     slot  the variable, or -1 for none.
+ * @param[in]     lo    the smallest value it may have.
+ * @param[in]     hi    the largest value it may have.
+ * @return        <code>FALSE</code> if no value is left, or
+ *                <code>TRUE</code> otherwise.
+ */
+static Boolean narrow(Value *state, int slot, long long lo, long long hi)
+{
+	if (slot < 0) {
+		return TRUE;
+	}
+	state[slot].lo = (int) HIGHER(state[slot].lo, lo);
+	state[slot].hi = (int) LOWER(state[slot].hi, hi);
+	return state[slot].lo <= state[slot].hi;
+}
+
+/**
+ * Determines where a switch goes, if the key it tests is a constant.
+ *
+ * @param[in]  c      the instruction, followed by its operands.
+ * @param[in]  sp     the position just above the top of the stack before the
+ *                    instruction.
+ * @param[out] target the label to which it jumps.
+ * @return     <code>TRUE</code> if the outcome is known, or
+ *             <code>FALSE</code> otherwise.
+ */
+static Boolean decide_switch(Code *c, Value *sp, Label *target)
+{
+	int a, n, j;
+
+	if ((c->code != JVM_LOOKUPSWITCH && c->code != JVM_TABLESWITCH)
+			|| !IS_CONSTANT(sp[-1])) {
+		return FALSE;
+	}
+	a = sp[-1].lo;
+	if (c->code == JVM_LOOKUPSWITCH) {
+		n = c[1].num;
+		for (j = 0; j < n && c[2 + 2 * j].num != a; j++)
+			;
+		*target = (j < n ? c[3 + 2 * j].label : c[2 + 2 * n].label);
+	} else {
+		n = c[2].num - c[1].num + 1;
+		j = (a >= c[1].num && a <= c[2].num ? a - c[1].num : n);
+		*target = c[3 + j].label;
+	}
+	return TRUE;
+}
+
+/**
+ * Records the arguments passed by the reachable calls in a method body to
+ * the functions and procedures of the class.  If the ranges of the body
+ * cannot be computed, every call is taken to pass varying arguments.
+ *
+ * @param[in]     b          the method body.
+ * @param[in]     bodies     the list of method bodies.
+ * @param[in]     class_name the name of the class.
+ * @param[in]     params     the values assumed for the parameters of b.
+ * @param[in,out] seen       the arguments passed so far to every body, in
+ *                           list order, merged with those of these calls.
+ */
+static void gather_arguments(Body *b, Body *bodies, const char *class_name,
+		Value *params, Value **seen)
+{
+	Flow f;
+	Ranges k;
+	Body *callee;
+	Value *sp, *v;
+	Boolean known;
+	int i, p, n, j;
+
+	build_flow(b, &f);
+	known = compute_ranges(b, &f, params, &k);
+
+	for (i = 0; i < f.ninstr; i++) {
+		Code *c = &b->code[f.pos[i]];
+		if (c->code != JVM_INVOKESTATIC
+				|| (callee = find_callee(bodies, c[1].string, class_name))
+					== NULL
+				|| (known && k.depth[i] < 0)) {
+			continue;
+		}
+		j = body_index(bodies, callee);
+		n = callee->idprop->nparams;
+		sp = (known ? &k.value[(size_t) i * k.width + k.nvars + k.depth[i]]
+				: NULL);
+		for (p = 0; p < n; p++) {
+			v = &seen[j][p];
+			if (!known || callee->signature != NULL
+					|| IS_ARRAY_TYPE(callee->idprop->params[p])
+					|| !IS_CONSTANT(sp[p - n])) {
+				*v = varying();
+			} else if (v->known == VALUE_UNSET) {
+				*v = constant(sp[p - n].lo);
+			} else if (IS_CONSTANT(*v) && v->lo != sp[p - n].lo) {
+				*v = varying();
+			}
+		}
+	}
+
+	release_ranges(&k);
+	release_flow(&f);
+}
+
+/**
+ * Rewrites a method body with what is known about its values: loads of
+ * constant variables become constants, operations on constants are folded,
+ * branches with known outcomes become jumps (or nothing), instructions that
+ * are never reached are removed, and stores to variables that are not read
+ * again are dropped.  Division and remainder of a value that cannot be
+ * negative by a power of two become a shift and a mask.
+ *
+ * @param[in,out] b      the method body.
+ * @param[in]     params the values of the parameters on entry.
+ * @return        <code>TRUE</code> if the body changed, or <code>FALSE</code>
+ *                otherwise.
+ */
+static Boolean fold_body(Body *b, Value *params)
+{
+	Flow f;
+	Ranges k;
+	Liveness l;
+	Buffer buf;
+	Code *c = b->code;
+	Value *in, *sp, *edge, r;
+	Label target;
+	int i, j, n, next, pop, push, old_ip, shift;
+	Boolean live, jumps, falls, changed = FALSE;
+
+	build_flow(b, &f);
+	if (!compute_ranges(b, &f, params, &k)) {
+		release_ranges(&k);
+		release_flow(&f);
+		return FALSE;
+	}
+	live = compute_liveness(b, &f, &l);
+	edge = emalloc((k.nvars + 1) * sizeof(Value));
+
+	buf.size = b->ip + 1;
+	buf.code = emalloc(buf.size * sizeof(Code));
+	buf.ip = 0;
+	for (i = 0, n = 0; i < b->ip; i = next) {
+		for (next = i + 1; next < b->ip && (c[next].type & CODE_OPERAND);
+				next++)
+			;
+		if (c[i].type != CODE_INSTRUCTION) {
+			emit(&buf, c[i].type, 0);
+			buf.code[buf.ip - 1] = c[i];
+			continue;
+		}
+
+		if (k.depth[n] < 0) {
+			for (j = i + 1; j < next; j++) {
+				if (c[j].type & CODE_ALLOCATED) {
+					free(c[j].string);
+				}
+			}
+			n++;
+			changed = TRUE;
+			continue;
+		}
+		in = &k.value[(size_t) n * k.width];
+		sp = &in[k.nvars + k.depth[n]];
+		r = varying();
+		if (c[i].code == JVM_INEG) {
+			r = arithmetic(c[i].code, &sp[-1], NULL);
+		} else if (k.depth[n] >= 2) {
+			r = arithmetic(c[i].code, &sp[-2], &sp[-1]);
+		}
+		/* a division by zero must still fail */
+		if ((c[i].code == JVM_IDIV || c[i].code == JVM_IREM)
+				&& sp[-1].lo <= 0 && sp[-1].hi >= 0) {
+			r = varying();
+		}
+		jumps = falls = TRUE;
+		if (is_conditional(c[i].code)) {
+			memcpy(edge, in, k.nvars * sizeof(Value));
+			jumps = refine(&c[i], sp, edge, TRUE);
+			memcpy(edge, in, k.nvars * sizeof(Value));
+			falls = refine(&c[i], sp, edge, FALSE);
+		}
+
+		if (IS_INSTRUCTION(c[i], JVM_ILOAD) && IS_CONSTANT(in[c[i + 1].num])) {
+			emit(&buf, CODE_INSTRUCTION, JVM_LDC);
+			emit(&buf, CODE_OPERAND | CODE_INTEGER, in[c[i + 1].num].lo);
+		} else if ((IS_INSTRUCTION(c[i], JVM_ISTORE)
+					|| IS_INSTRUCTION(c[i], JVM_IINC))
+				&& live && !HAS_BIT(&l.out[n * l.nw], c[i + 1].num)) {
+			if (c[i].code == JVM_ISTORE) {
+				emit_pop(&buf);
+			}
+		} else if (IS_INSTRUCTION(c[i], JVM_POP) && drop_pushed(&buf)) {
+			/* neither the value nor the pop is needed */
+		} else if (jumps != falls) {
+			stack_effect(&c[i], &pop, &push);
+			while (pop-- > 0) {
+				emit_pop(&buf);
+			}
+			if (jumps) {
+				emit(&buf, CODE_INSTRUCTION, JVM_GOTO);
+				emit(&buf, CODE_LABEL | CODE_OPERAND, c[i + 1].label);
+			}
+		} else if (decide_switch(&c[i], sp, &target)) {
+			emit_pop(&buf);
+			emit(&buf, CODE_INSTRUCTION, JVM_GOTO);
+			emit(&buf, CODE_LABEL | CODE_OPERAND, target);
+		} else if (IS_CONSTANT(r)) {
+			stack_effect(&c[i], &pop, &push);
+			while (pop-- > 0) {
+				emit_pop(&buf);
+			}
+			emit(&buf, CODE_INSTRUCTION, JVM_LDC);
+			emit(&buf, CODE_OPERAND | CODE_INTEGER, r.lo);
+		} else if ((c[i].code == JVM_IDIV || c[i].code == JVM_IREM)
+				&& sp[-2].lo >= 0 && IS_CONSTANT(sp[-1]) && sp[-1].lo > 0
+				&& (sp[-1].lo & (sp[-1].lo - 1)) == 0) {
+			/* x / 2^s is x >> s, and x rem 2^s is x & (2^s - 1) */
+			for (shift = 0; (1 << shift) < sp[-1].lo; shift++)
+				;
+			emit_pop(&buf);
+			if (c[i].code == JVM_IREM) {
+				emit(&buf, CODE_INSTRUCTION, JVM_LDC);
+				emit(&buf, CODE_OPERAND | CODE_INTEGER, sp[-1].lo - 1);
+				emit(&buf, CODE_INSTRUCTION, JVM_IAND);
+			} else if (shift > 0) {
+				emit(&buf, CODE_INSTRUCTION, JVM_LDC);
+				emit(&buf, CODE_OPERAND | CODE_INTEGER, shift);
+				emit(&buf, CODE_INSTRUCTION, JVM_ISHR);
+			}
+		} else {
+			for (j = i; j < next; j++) {
+				emit(&buf, c[j].type, 0);
+				buf.code[buf.ip - 1] = c[j];
+			}
+			n++;
+			continue;
+		}
+
+		/* the instruction was rewritten */
+		for (j = i + 1; j < next; j++) {
+			if (c[j].type & CODE_ALLOCATED) {
+				free(c[j].string);
+			}
+		}
+		n++;
+		changed = TRUE;
+	}
+
+	old_ip = buf.ip;
+	remove_jumps_to_next(&buf);
+	remove_unused_labels(&buf);
+	changed = changed || buf.ip != old_ip;
+
+	free(b->code);
+	b->code = buf.code;
+	b->ip = buf.ip;
+
+	free(edge);
+	release_liveness(&l);
+	release_ranges(&k);
+	release_flow(&f);
+
+	return changed;
+}
+
+/**
+ * Folds a method body until it no longer changes, or for at most
+ * <code>FOLD_PASSES</code> passes.
+ *
+ * @param[in,out] arg the method body, with the values of its parameters.
+ */
+static void fold_job(void *arg)
+{
+	Fold *fold = arg;
+	int pass;
+
+	for (pass = 0; pass < FOLD_PASSES && fold_body(fold->b, fold->params);
+			pass++)
+		;
+}
+
+/**
+ * Appends a <code>pop</code> to a code array, unless the value to be popped
+ * can be dropped where it is pushed.
+ *
+ * @param[in,out] buf the code array.
+ */
+static void emit_pop(Buffer *buf)
+{
+	if (!drop_pushed(buf)) {
+		emit(buf, CODE_INSTRUCTION, JVM_POP);
+	}
+}
+
+/**
+ * Removes the last instruction of a code array, if it only pushes a value
+ * without any other effect.
+ *
+ * @param[in,out] buf the code array.
+ * @return        <code>TRUE</code> if the instruction was removed, or
+ *                <code>FALSE</code> otherwise.
+ */
+static Boolean drop_pushed(Buffer *buf)
+{
+	Code *c;
+
+	if (buf->ip < 2) {
+		return FALSE;
+	}
+	c = &buf->code[buf->ip - 2];
+	if (c[0].type != CODE_INSTRUCTION || !(c[1].type & CODE_OPERAND)
+			|| (c[0].code != JVM_LDC && c[0].code != JVM_ILOAD
+				&& c[0].code != JVM_ALOAD)) {
+		return FALSE;
+	}
+
+	if (c[1].type & CODE_ALLOCATED) {
+		free(c[1].string);
+	}
+	buf->ip -= 2;
+	return TRUE;
+}
+
+/**
+ * Removes every <code>goto</code> to a label that follows it directly, with
+ * nothing but labels and marks in between.
+ *
+ * @param[in,out] buf the code array.
+ */
+static void remove_jumps_to_next(Buffer *buf)
+{
+	Code *c = buf->code;
+	int i, j, n;
+
+	for (i = 0, n = 0; i < buf->ip; i++) {
+		if (IS_INSTRUCTION(c[i], JVM_GOTO)) {
+			for (j = i + 2; j < buf->ip && (c[j].type == CODE_LABEL
+						|| (c[j].type & MASK_TYPE) == CODE_MARK)
+					&& !(c[j].type == CODE_LABEL
+						&& c[j].label == c[i + 1].label); j++)
+				;
+			if (j < buf->ip && c[j].type == CODE_LABEL
+					&& c[j].label == c[i + 1].label) {
+				i++;
+				continue;
+			}
+		}
+		c[n++] = c[i];
+	}
+	buf->ip = n;
+}
+
+/**
+ * Removes the labels to which nothing jumps.
+ *
+ * @param[in,out] buf the code array.
+ */
+static void remove_unused_labels(Buffer *buf)
+{
+	Code *c = buf->code;
+	Label minl = (Label) -1, maxl = 0;
+	Boolean *used;
+	int i, n;
+
+	for (i = 0; i < buf->ip; i++) {
+		if (c[i].type & CODE_LABEL) {
+			if (c[i].label < minl) {
+				minl = c[i].label;
+			}
+			if (c[i].label > maxl) {
+				maxl = c[i].label;
+			}
+		}
+	}
+	if (minl > maxl) {
+		return;
+	}
+
+	used = emalloc((maxl - minl + 1) * sizeof(Boolean));
+	for (i = 0; i <= (int) (maxl - minl); i++) {
+		used[i] = FALSE;
+	}
+	for (i = 0; i < buf->ip; i++) {
+		if (IS_TARGET(c[i])) {
+			used[c[i].label - minl] = TRUE;
+		}
+	}
+	for (i = 0, n = 0; i < buf->ip; i++) {
+		if (c[i].type != CODE_LABEL || used[c[i].label - minl]) {
+			c[n++] = c[i];
+		}
+	}
+	buf->ip = n;
+
+	free(used);
+}
@@ -0,0 +1,94 @@
+/**
+ * @file    optimise.h
+ * @brief   Optimisation passes over the generated code of ALAN-2022 methods.
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @date    2022-08-03
+ */
+
+#ifndef OPTIMISE_H
+#define OPTIMISE_H
+
+#include "bytecode.h"
+
+/**
+ * Reassigns the local variable slots of a method body, so that variables whose
+ * live ranges do not overlap share a slot.  Parameters (and the argument array
+ * of <code>main</code>) keep their slots.  The local variable operands and the
+ * width of the local variable array of the body are updated in place.
+ *
+ * @param[in,out]   b
+ *     the method body
+ */
+void allocate_locals(Body *b);
+
+/**
+ * Determines which methods are pure, which is to say, neither read input, nor
+ * write output, nor store into arrays they receive as parameters, and call
+ * only pure methods.  A call to a pure method with the same arguments always
+ * has the same result, and nothing else to show for it, unless it fails to
+ * return.  The <code>pure</code> field of every body from <code>from</code> on
+ * is set accordingly; the bodies before it are taken to be settled already,
+ * which they are if none of them calls a method from <code>from</code> on.
+ *
+ * @param[in,out]   bodies
+ *     the list of all method bodies of the class
+ * @param[in,out]   from
+ *     the first body in the list whose purity is to be determined
+ * @param[in]       class_name
+ *     the name of the class, used to recognise invocations of its methods
+ */
+void find_pure_functions(Body *bodies, Body *from, const char *class_name);
+
+/**
+ * Propagates constants through the method bodies of the class, and within
+ * each of them.  A parameter to which every reachable call passes the same
+ * constant is treated as that constant in the body of the callee.  Within a
+ * body, the range of every integer variable is tracked, and narrowed by the
+ * tests of the conditional jumps.  Loads of constant variables and operations
+ * on constants are then folded, branches whose outcomes are known become
+ * jumps, or disappear, and the code that can no longer be reached is removed.
+ * Division and remainder of values that cannot be negative by powers of two
+ * become shifts and masks.  The bodies are folded as jobs of their own.  The
+ * maximum stack depths of the bodies are not updated.
+ *
+ * @param[in,out]   bodies
+ *     the list of all method bodies of the class
+ * @param[in]       class_name
+ *     the name of the class, used to recognise invocations of its methods
+ */
+void propagate_constants(Body *bodies, const char *class_name);
+
+/**
+ * Removes the methods that cannot be reached from <code>main</code> through
+ * the call graph of the class, whose edges are the invocations in the method
+ * bodies.
+ *
+ * @param[in,out]   bodies
+ *     the list of all method bodies of the class, from which the unreachable
+ *     ones are unlinked
+ * @param[in]       class_name
+ *     the name of the class, used to recognise invocations of its methods
+ * @return      the list of the bodies that were removed, in their original
+ *              order, or <code>NULL</code> if every body is reachable
+ */
+Body *remove_unreachable(Body **bodies, const char *class_name);
+
+/**
+ * Splits a method body whose bytecode would be too large for the JIT compiler
+ * into smaller methods.  Runs of statements at the top level of the body
+ * (between marks), none of which returns, are moved into new methods, which
+ * are called in their place, and which receive and pass back the local
+ * variables they need in arrays.  The local variable slots of the new methods
+ * are not shared yet, and no maximum stack depths are set.
+ *
+ * @param[in,out]   b
+ *     the method body
+ * @param[in]       class_name
+ *     the name of the class, used in the invocations of the new methods
+ * @return      a list of the bodies of the new methods, linked to
+ *              <code>b</code>, or <code>NULL</code> if the body was left
+ *              unchanged
+ */
+Body *split_method(Body *b, const char *class_name);
+
+#endif /* OPTIMISE_H */
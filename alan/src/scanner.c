@@ -7,8 +7,12 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "boolean.h"
 #include "error.h"
 #include "scanner.h"
@@ -22,12 +26,49 @@ typedef struct {
 	TokenType  type;                   /* the associated token type           */
 } ReservedWord;
 
+typedef struct {                       /* where a scan is in the source       */
+	size_t     at;                     /* the offset just past the character  */
+	int        ch;                     /* the next source character           */
+	int        last;                   /* the character read before it        */
+	int        column;                 /* the current column number           */
+	SourcePos  pos;                    /* the position of the token           */
+	size_t     start;                  /* the offset of the token             */
+	jmp_buf   *bail;                   /* where a scan ahead stops on errors  */
+} ScanState;
+
+typedef struct {                       /* a token scanned ahead of time       */
+	Token         token;               /* the token                           */
+	unsigned int  start;               /* the offset of its first character   */
+	SourcePos     pos;                 /* its position, from the chunk start  */
+} Lexed;
+
+typedef struct {                       /* a stretch of the source             */
+	size_t     start;                  /* the offset of its first character   */
+	size_t     end;                    /* the offset just past its end        */
+	int        lines;                  /* the lines before it                 */
+	Lexed     *tokens;                 /* the tokens that start in it         */
+	size_t     ntokens;                /* the number of tokens                */
+	size_t     size;                   /* the space for tokens                */
+	size_t     next;                   /* the next token to hand out          */
+	ScanState  stop;                   /* where its scan stopped              */
+} Chunk;
+
 /* --- global static variables ---------------------------------------------- */
 
-static FILE *src_file;                 /* the source file pointer             */
-static int   ch;                       /* the next source character           */
-static int   column_number;            /* the current column number           */
-static int   t;
+static char *src_text;                 /* the whole of the source text        */
+static size_t src_length;              /* the length of the source text       */
+static Boolean parallel_loops;         /* whether 'parallel' is reserved      */
+static int   jobs = 1;                 /* the number of threads to scan with  */
+static Chunk *chunks;                  /* the stretches scanned ahead of time */
+static int   nchunks;                  /* the number of stretches             */
+static int   current;                  /* the stretch handing out tokens      */
+static int   following;                /* the stretch to fall in with next    */
+
+/* the parse may move on to other threads (for deep nesting), all of which
+ * share the scan in source order; only a scan ahead of time has its own
+ */
+static ScanState in_order;             /* the scan in source order            */
+static _Thread_local ScanState *scan = &in_order; /* the scan of the thread   */
 
 static ReservedWord reserved[] = {     /* reserved words                      */
 
@@ -37,61 +78,337 @@ static ReservedWord reserved[] = {     /* reserved words                      */
 	{"false", TOKEN_FALSE},	{"function", TOKEN_FUNCTION}, {"get", TOKEN_GET},
 	{"if", TOKEN_IF}, {"integer", TOKEN_INTEGER},
 	{"leave", TOKEN_LEAVE}, {"not", TOKEN_NOT}, {"or", TOKEN_OR},
-	{"put", TOKEN_PUT}, {"relax", TOKEN_RELAX}, {"rem", TOKEN_REMAINDER},
+	{"parallel", TOKEN_PARALLEL}, {"put", TOKEN_PUT}, {"relax", TOKEN_RELAX},
+	{"rem", TOKEN_REMAINDER},
 	{"source", TOKEN_SOURCE}, {"then", TOKEN_THEN}, {"to", TOKEN_TO},
 	{"true", TOKEN_TRUE}, {"while", TOKEN_WHILE}
 
 };
 
 #define NUM_RESERVED_WORDS     (sizeof(reserved) / sizeof(ReservedWord))
-#define MAX_INITIAL_STRING_LEN (1024)
+#define INITIAL_SOURCE_SIZE    (64 * 1024)
+#define MIN_CHUNK              (16 * 1024 * 1024)
+#define INITIAL_TOKENS         1024
+#define MAX_MESSAGE_LENGTH     256
 
 /* --- function prototypes -------------------------------------------------- */
 
+static void scan_token(Token *token);
+static void scan_ahead(void);
+static void *scan_chunk(void *arg);
+static void fall_in(void);
+static void save_state(ScanState *state);
+static void restore_state(const ScanState *state, int lines);
+static void scan_error(const char *fmt, ...);
 static void next_char(void);
 static void process_number(Token *token);
 static void process_string(Token *token);
 static void process_word(Token *token);
 static void skip_comment(void);
+static int compare_word(const char *lexeme, unsigned int length,
+		const char *word);
 
 /* --- scanner interface ---------------------------------------------------- */
 
 void init_scanner(FILE *in_file)
 {
-	src_file = in_file;
-	position.line = 1;
-	position.col = column_number = 0;
+	size_t n, size = INITIAL_SOURCE_SIZE;
+
+	/* the source is read in one go, so that tokens can refer to their text in
+	 * it, rather than copy it
+	 */
+	src_text = emalloc(size);
+	src_length = scan->at = 0;
+	while ((n = fread(src_text + src_length, 1, size - src_length, in_file))
+			> 0) {
+		src_length += n;
+		if (src_length == size) {
+			size *= 2;
+			src_text = erealloc(src_text, size);
+		}
+	}
+	if (ferror(in_file)) {
+		eprintf("file '%s' could not be read:", getsrcname());
+	}
+
+	scan->pos.line = 1;
+	scan->pos.col = scan->column = 0;
 	next_char();
+	position = scan->pos;
+}
+
+void set_parallel_loops(Boolean enable)
+{
+	parallel_loops = enable;
+}
+
+void set_scanning_jobs(int njobs)
+{
+	jobs = njobs;
 }
 
 void get_token(Token *token)
 {
+	Chunk *c;
+	Lexed *l;
+
+	if (jobs > 1 && chunks == NULL) {
+		scan_ahead();
+	}
+
+	/* while the scan ahead of time is known to be right, its tokens stand */
+	if (current < nchunks) {
+		c = &chunks[current];
+		if (c->next < c->ntokens) {
+			l = &c->tokens[c->next++];
+			*token = l->token;
+			position.line = l->pos.line + c->lines;
+			position.col = l->pos.col;
+			return;
+		}
+		restore_state(&c->stop, c->lines);
+		free(c->tokens);
+		c->tokens = NULL;
+		following = current + 1;
+		current = nchunks;
+	}
+
+	scan_token(token);
+	position = scan->pos;
+	if (following < nchunks) {
+		fall_in();
+	}
+}
+
+char *copy_lexeme(const Token *token)
+{
+	char *s;
+
+	s = emalloc(token->span.length + 1);
+	memcpy(s, src_text + token->span.offset, token->span.length);
+	s[token->span.length] = '\0';
+	return s;
+}
+
+const char *get_lexeme(const Token *token)
+{
+	return src_text + token->span.offset;
+}
+
+/* --- scanning ahead of time ----------------------------------------------- */
+
+/* splits the source into stretches that start at the start of a line, and
+ * scans all of them at once, each on a thread of its own; a stretch is scanned
+ * as if it did not start inside a comment, and if it does, its tokens are not
+ * used, and it is scanned again in turn
+ */
+void scan_ahead(void)
+{
+	pthread_t *threads;
+	const char *nl;
+	size_t from;
+	int i, n, lines;
+	long cpus;
+
+	n = (src_length / MIN_CHUNK < (size_t) jobs
+			? (int) (src_length / MIN_CHUNK) : jobs);
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 0 && cpus < n) {
+		n = (int) cpus;
+	}
+	chunks = emalloc((n > 0 ? n : 1) * sizeof(Chunk));
+	nchunks = 0;
+	for (i = 0; i < n; i++) {
+		from = (src_length / n) * i;
+		if (i > 0) {
+			nl = memchr(src_text + from, '\n', src_length - from);
+			if (nl == NULL || (size_t) (nl - src_text) + 1 >= src_length) {
+				break;
+			}
+			from = nl - src_text + 1;
+			if (from <= chunks[nchunks - 1].start) {
+				continue;
+			}
+			chunks[nchunks - 1].end = from;
+		}
+		chunks[nchunks++].start = from;
+	}
+	if (nchunks < 2) {
+		nchunks = 0;
+		return;
+	}
+	chunks[nchunks - 1].end = src_length;
+
+	threads = emalloc(nchunks * sizeof(pthread_t));
+	for (i = 0; i < nchunks; i++) {
+		if (pthread_create(&threads[i], NULL, scan_chunk, &chunks[i]) != 0) {
+			eprintf("could not start a thread to scan the source");
+		}
+	}
+	for (i = 0; i < nchunks; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	/* each stretch counted its own lines */
+	for (i = 0, lines = 0; i < nchunks; i++) {
+		n = chunks[i].lines;
+		chunks[i].lines = lines;
+		lines += n;
+	}
+	current = 0;
+	following = 1;
+}
+
+/* scans a stretch of the source, up to the first token that starts past its
+ * end, or up to the first error, which is left for the scan in turn to report
+ */
+void *scan_chunk(void *arg)
+{
+	Chunk *c = arg;
+	ScanState ahead;
+	jmp_buf env;
+	Token token;
+	Lexed *l;
+	const char *p, *end;
+
+	scan = &ahead;
+	scan->at = c->start;
+	scan->ch = scan->last = '\0';
+	scan->pos.line = 1;
+	scan->pos.col = scan->column = 0;
+	next_char();
+
+	c->size = INITIAL_TOKENS;
+	c->tokens = emalloc(c->size * sizeof(Lexed));
+	c->ntokens = c->next = 0;
+	scan->bail = &env;
+	if (setjmp(env) == 0) {
+		for (;;) {
+			save_state(&c->stop);
+			scan_token(&token);
+			if (token.type == TOKEN_EOF || scan->start >= c->end) {
+				break;
+			}
+			if (c->ntokens == c->size) {
+				c->size *= 2;
+				c->tokens = erealloc(c->tokens, c->size * sizeof(Lexed));
+			}
+			l = &c->tokens[c->ntokens++];
+			l->token = token;
+			l->start = scan->start;
+			l->pos = scan->pos;
+		}
+	}
+	scan = &in_order;
+
+	c->lines = 0;
+	end = src_text + c->end;
+	for (p = src_text + c->start; (p = memchr(p, '\n', end - p)) != NULL;
+			p++) {
+		c->lines++;
+	}
+	return NULL;
+}
+
+/* hands out the tokens of the next stretch from the token just scanned on, if
+ * the scan ahead of time found that token too, since from a token on which
+ * they agree, both scans go the same way
+ */
+void fall_in(void)
+{
+	Chunk *c;
+
+	while (following < nchunks) {
+		c = &chunks[following];
+		while (c->next < c->ntokens && c->tokens[c->next].start < scan->start) {
+			c->next++;
+		}
+		if (c->next < c->ntokens) {
+			if (c->tokens[c->next].start == scan->start) {
+				c->next++;
+				current = following;
+			}
+			return;
+		}
+
+		/* the scan in turn is past the whole stretch */
+		free(c->tokens);
+		c->tokens = NULL;
+		following++;
+	}
+}
+
+void save_state(ScanState *state)
+{
+	state->at = scan->at;
+	state->ch = scan->ch;
+	state->last = scan->last;
+	state->column = scan->column;
+	state->pos = scan->pos;
+}
+
+void restore_state(const ScanState *state, int lines)
+{
+	scan->at = state->at;
+	scan->ch = state->ch;
+	scan->last = state->last;
+	scan->column = state->column;
+	scan->pos = state->pos;
+	scan->pos.line += lines;
+}
+
+/* reports a lexical error at the position of the scan, or, ahead of time,
+ * stops the scan
+ */
+void scan_error(const char *fmt, ...)
+{
+	va_list args;
+	char message[MAX_MESSAGE_LENGTH];
+
+	if (scan->bail != NULL) {
+		longjmp(*scan->bail, 1);
+	}
+	va_start(args, fmt);
+	vsnprintf(message, MAX_MESSAGE_LENGTH, fmt, args);
+	va_end(args);
+	position = scan->pos;
+	leprintf("%s", message);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+void scan_token(Token *token)
+{
+	int t;
+
 	/* remove whitespace */
 
-	while (ch == ' ' || ch == '\t' || ch == '\n') {
+	while (scan->ch == ' ' || scan->ch == '\t' || scan->ch == '\n') {
 		next_char();
 	}
 
 	/* remember token start */
-	position.col = column_number;
+	scan->pos.col = scan->column;
+	scan->start = scan->at - (scan->ch != EOF);
 
 	/* get the next token */
-	if (ch != EOF) {
-		if (isalpha(ch) || ch == '_') {
+	if (scan->ch != EOF) {
+		if (isalpha(scan->ch) || scan->ch == '_') {
 
 			/* process a word */
 			process_word(token);
 
-		} else if (isdigit(ch)) {
+		} else if (isdigit(scan->ch)) {
 
 			/* process a number */
 			process_number(token);
 
-		} else switch (ch) {
+		} else switch (scan->ch) {
 
 			/* process a string */
 			case '"':
-				position.col = column_number;
+				scan->pos.col = scan->column;
 				next_char();
 				process_string(token);
 				break;
@@ -100,7 +417,7 @@ void get_token(Token *token)
 			case '{':
 				skip_comment();
 				next_char();
-				get_token(token);
+				scan_token(token);
 
 			/*process other tokens */
 				break;
@@ -115,7 +432,7 @@ void get_token(Token *token)
 				break;
 
 			case '}':
-				leprintf("illegal character '%c' (ASCII #%d)", ch, ch);
+				scan_error("illegal character '%c' (ASCII #%d)", scan->ch, scan->ch);
 				token->type = TOKEN_OPEN_PARENTHESIS;
 				next_char();
 				break;
@@ -163,61 +480,65 @@ void get_token(Token *token)
 			case '.':
 				token->type = TOKEN_CONCATENATE;
 				next_char();
+				if (scan->ch == '.') {
+					token->type = TOKEN_RANGE;
+					next_char();
+				}
 				break;
 
 			case ':':
-				t = ch;
+				t = scan->ch;
 				next_char();
-				if (ch == '=') {
+				if (scan->ch == '=') {
 					token->type = TOKEN_GETS;
 					next_char();
 					break;
 
 					} else {
-						leprintf("illegal character '%c' (ASCII #%d)", t, t);
+						scan_error("illegal character '%c' (ASCII #%d)", t, t);
 						break;
 					}
 
 			case '<':
 				next_char();
-				if (ch == ' ') {
+				if (scan->ch == ' ') {
 					token->type = TOKEN_LESS_THAN;
 					next_char();
 					break;
 				}
 
-				if (ch == '>') {
+				if (scan->ch == '>') {
 					token->type = TOKEN_NOT_EQUAL;
 					next_char();
 					break;
 				}
 
-				if (ch == '=') {
+				if (scan->ch == '=') {
 					token->type = TOKEN_LESS_EQUAL;
 					next_char();
 					break;
 				}
 
-				if (ch != ' ' || ch != '=' || ch != '>') {
+				if (scan->ch != ' ' || scan->ch != '=' || scan->ch != '>') {
 					token->type = TOKEN_LESS_THAN;
 					break;
 				}
 
 			case '>':
 				next_char();
-				if (ch == ' ') {
+				if (scan->ch == ' ') {
 					token->type = TOKEN_GREATER_THAN;
 					next_char();
 					break;
 				}
 
-				if (ch == '=') {
+				if (scan->ch == '=') {
 					token->type = TOKEN_GREATER_EQUAL;
 					next_char();
 					break;
 				}
 
-				if (ch != ' ' || ch != '=') {
+				if (scan->ch != ' ' || scan->ch != '=') {
 					token->type = TOKEN_GREATER_THAN;
 					break;
 				}
@@ -228,7 +549,7 @@ void get_token(Token *token)
 				break;
 
 			default:
-				leprintf("illegal character '%c' (ASCII #%d)", ch, ch);
+				scan_error("illegal character '%c' (ASCII #%d)", scan->ch, scan->ch);
 		}
 
 	} else {
@@ -236,11 +557,8 @@ void get_token(Token *token)
 	}
 }
 
-/* --- utility functions ---------------------------------------------------- */
-
 void next_char(void)
 {
-	static char last_read = '\0';
     /*
      * - Allocate heap space of the size of the maximum initial string length.
      * - If a string is *about* to overflow while scanning it, double the amount
@@ -249,17 +567,17 @@ void next_char(void)
      * - Check the legality of escape codes.
      * - Set the appropriate token type.
      */
-	last_read = ch;
-	ch = fgetc(src_file);
+	scan->last = scan->ch;
+	scan->ch = (scan->at < src_length ? (unsigned char) src_text[scan->at++] : EOF);
 
-	if (ch != EOF) {
-		if (last_read == '\n') {
-			position.line++;
-			column_number = 1;
+	if (scan->ch != EOF) {
+		if (scan->last == '\n') {
+			scan->pos.line++;
+			scan->column = 1;
 		}
 
-		if (last_read != '\n') {
-			column_number++;
+		if (scan->last != '\n') {
+			scan->column++;
 		}
 	}
 }
@@ -275,18 +593,18 @@ void process_number(Token *token)
      */
 
 
-	int d = ch - '0';
+	int d = scan->ch - '0';
 	int v = 0;
 
-	while (isdigit(ch)) {
-		d = ch - '0';
+	while (isdigit(scan->ch)) {
+		d = scan->ch - '0';
 
 		if (v <= ((INT_MAX - d)/10)) {
 			v = 10 * v + d;
 			next_char();
 
 		} else {
-			leprintf("number too large");
+			scan_error("number too large");
 		}
 	}
 
@@ -296,131 +614,95 @@ void process_number(Token *token)
 
 void process_string(Token *token)
 {
-	size_t i, nstring = MAX_INITIAL_STRING_LEN;
-
-	 /*
-     * - Allocate heap space of the size of the maximum initial string length.
-     * - If a string is *about* to overflow while scanning it, double the amount
-     *   of space available.
+	/*
      * - *Only* printable ASCII characters are allowed; see man 3 isalpha.
      * - Check the legality of escape codes.
      * - Set the appropriate token type.
      */
 
-	char *string;
-	string = (char *)malloc(nstring);
-	i = 0;
+	/* the text of the string is that of the source, escape codes and all, so
+	 * that the token need only say where it is
+	 */
+	token->span.offset = scan->at - 1;
 
-	while (ch != '"' && ch != EOF) {
-		if(!isprint(ch)) {
-			position.col = column_number;
-			leprintf("non-printable character (ASCII #%d) in string", ch);
+	while (scan->ch != '"' && scan->ch != EOF) {
+		if(!isprint(scan->ch)) {
+			scan->pos.col = scan->column;
+			scan_error("non-printable character (ASCII #%d) in string", scan->ch);
 		}
 
-		if (ch == '\\') {
+		if (scan->ch == '\\') {
 			next_char();
-			position.col = column_number;
-			position.col--;
-			if (ch == 'a' || ch == 'b' || ch == 'f' || ch == 'r'
-				|| ch == 'v' || ch == '\''|| ch == '?') {
-					leprintf("illegal escape code '\\%c' in string", ch);
+			scan->pos.col = scan->column;
+			scan->pos.col--;
+			if (scan->ch == 'a' || scan->ch == 'b' || scan->ch == 'f' || scan->ch == 'r'
+				|| scan->ch == 'v' || scan->ch == '\''|| scan->ch == '?') {
+					scan_error("illegal escape code '\\%c' in string", scan->ch);
 					break;
-
-			} else {
-				string[i] = '\\';
-				i++;
 			}
 		}
 
-		string[i] = ch;
-		i++;
 		next_char();
-
-		if (i >= nstring) {
-			nstring *= 2;
-			string = realloc(string, nstring);
-		}
-	}
-
-	if (i > 0) {
-		string = realloc(string, i);
-	}
-
-	if (i == 0) {
-		i++;
-		string = realloc(string, i);
 	}
 
-	if (ch == EOF) {
-		leprintf("string not closed");
+	if (scan->ch == EOF) {
+		scan_error("string not closed");
 	}
 
-	i++;
-	string[i] = '\0';
-	token-> string = string;
+	token->span.length = scan->at - 1 - token->span.offset;
 	token->type = TOKEN_STRING;
 	next_char();
 }
 
 void process_word(Token *token)
 {
-	char lexeme[MAX_ID_LENGTH+1];
-	int i, low, mid, high;
-	i = 0;
-	position.col = column_number;
-
-	/* check that the id length is less than the maximum */
+	const char *lexeme;
+	unsigned int i;
+	int low, mid, high, cmp, index;
 
-    /* do a binary search through the array of reserved words */
+	scan->pos.col = scan->column;
+	lexeme = src_text + scan->at - 1;
 
-    /* if id was not recognised as a reserved word, it is an identifier */
-
-	int c = 0;
-	while (isalpha(ch) || isdigit(ch) || ch == '_') {
+	/* check that the id length is less than the maximum */
+	i = 0;
+	while (isalpha(scan->ch) || isdigit(scan->ch) || scan->ch == '_') {
 		if (i < MAX_ID_LENGTH) {
-			lexeme[i] = ch;
-			c++;
 			next_char();
 			i++;
 
 		} else {
-			leprintf("identifier too long");
+			scan_error("identifier too long");
 			break;
 		}
 	}
 
-	lexeme[i] = '\0';
+	/* do a binary search through the array of reserved words */
 	low = 0;
 	high = NUM_RESERVED_WORDS - 1;
-	mid = 0;
-	int index = -1;
+	index = -1;
 
 	while (low <= high) {
-		if (low > high) {
-			index = -1;
-			break;
-		}
-
 		mid = low + (high - low) / 2;
+		cmp = compare_word(lexeme, i, reserved[mid].word);
 
-		if (strcmp(lexeme, reserved[mid].word) < 0) {
+		if (cmp < 0) {
 			high = mid - 1;
-		}
-
-		if (strcmp(lexeme, reserved[mid].word) == 0) {
+		} else if (cmp > 0) {
+			low = mid + 1;
+		} else {
 			index = mid;
 			break;
 		}
-
-		if (strcmp(lexeme, reserved[mid].word) > 0) {
-			low = mid + 1;
-		}
 	}
 
-	/* if id was not recognised as a reserved word, it is an identifier */
-	if (index == -1) {
+	/* if id was not recognised as a reserved word, it is an identifier; the
+	 * parallel loop is an extension, which must be asked for
+	 */
+	if (index == -1 || (reserved[index].type == TOKEN_PARALLEL
+				&& !parallel_loops)) {
 		token->type = TOKEN_ID;
-		strcpy(token->lexeme, lexeme);
+		token->span.offset = lexeme - src_text;
+		token->span.length = i;
 
 	} else {
 		token->type = reserved[index].type;
@@ -437,12 +719,12 @@ void skip_comment(void)
      * - Terminate with an error if comments are not nested properly.
      */
 
-	start_pos.line = position.line;
-	start_pos.col = column_number;
+	start_pos.line = scan->pos.line;
+	start_pos.col = scan->column;
 	next_char();
 
-	while (ch != '}' && ch != EOF) {
-		if (ch == '{') {
+	while (scan->ch != '}' && scan->ch != EOF) {
+		if (scan->ch == '{') {
 			skip_comment();
 		}
 
@@ -450,9 +732,23 @@ void skip_comment(void)
 	}
 
 	/* force line number of error reporting */
-	if (ch == EOF) {
-		position = start_pos;
-		leprintf("comment not closed");
+	if (scan->ch == EOF) {
+		scan->pos = start_pos;
+		scan_error("comment not closed");
 	}
 
 }
+
+/* compares a lexeme, which is not nul-terminated, with a reserved word, as
+ * strcmp would if the lexeme were a string
+ */
+int compare_word(const char *lexeme, unsigned int length, const char *word)
+{
+	int cmp;
+
+	cmp = strncmp(lexeme, word, length);
+	if (cmp == 0 && word[length] != '\0') {
+		cmp = -1;
+	}
+	return cmp;
+}
@@ -10,16 +10,45 @@
 #define SCANNER_H
 
 #include <stdio.h>
+#include "boolean.h"
 #include "token.h"
 
 /**
- * Initialises the scanner.
+ * Initialises the scanner, which reads the whole of the source file into
+ * memory, and scans it from there.
  *
  * @param[in]   in_file
  *     the (already open) source file
  */
 void init_scanner(FILE *in_file);
 
+/**
+ * Sets whether <code>parallel</code> is a reserved word, which introduces a
+ * parallel loop.  By default, it is an ordinary identifier.
+ *
+ * @param[in]   enable
+ *     whether to recognise parallel loops
+ */
+void set_parallel_loops(Boolean enable);
+
+/**
+ * Sets the number of threads with which to scan the source.  With more than
+ * one, the source is split into stretches that start at the start of a line,
+ * and these are scanned at once, ahead of the parser, when it asks for the
+ * first token.  The tokens of a stretch are used only once the scan in source
+ * order agrees with it on a token, which it does unless the stretch starts
+ * inside a comment; lexical errors are reported only when the scan in source
+ * order reaches them, as they would be by a single thread.  Only sources of
+ * many megabytes are split, and into no more stretches than there are
+ * processors online, since scanning is a small part of compiling and the
+ * tokens kept for each stretch cost about as much as scanning it.  By default,
+ * the source is scanned by a single thread.
+ *
+ * @param[in]   njobs
+ *     the number of threads to scan with
+ */
+void set_scanning_jobs(int njobs);
+
 /**
  * Gets the next token from the input (source) file.
  *
@@ -28,4 +57,25 @@ void init_scanner(FILE *in_file);
  */
 void get_token(Token *token);
 
+/**
+ * Returns a copy of the lexeme of an identifier, or of the text of a string,
+ * as a nul-terminated string on the heap, which the caller must free.
+ *
+ * @param[in]   token
+ *     an identifier or string token
+ * @return      the copy of the lexeme
+ */
+char *copy_lexeme(const Token *token);
+
+/**
+ * Returns where the lexeme of an identifier, or the text of a string, starts
+ * in the source text.  The lexeme is not nul-terminated; its length is given
+ * by the span of the token.  The source text lives as long as the program.
+ *
+ * @param[in]   token
+ *     an identifier or string token
+ * @return      the start of the lexeme
+ */
+const char *get_lexeme(const Token *token);
+
 #endif /* SCANNER_H */
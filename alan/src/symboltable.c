@@ -24,7 +24,7 @@ static HashTab *table, *saved_table;
  * during code generation to compute the size of the local variable array of a
  * method frame in the Java virtual machine.
  */
-static unsigned int curr_offset;
+static unsigned int curr_offset, saved_offset;
 
 /* --- function prototypes -------------------------------------------------- */
 
@@ -60,6 +60,7 @@ Boolean open_subroutine(char *id, IDprop *prop)
 	if (b) {
 		saved_table = table;
 		table = ht_init(0.75f, shift_hash, key_strcmp);
+		saved_offset = curr_offset;
 		curr_offset = 0;
 	}
 
@@ -72,6 +73,8 @@ void close_subroutine(void)
 
 		ht_free(table, free, freeprop);
 		table = saved_table;
+		saved_table = NULL;
+		curr_offset = saved_offset;
 
 }
 
@@ -22,9 +22,8 @@ int main(int argc, char *argv[])
 	Token token;
 	FILE *in_file;
 
-	/* set up program name and token */
+	/* set up program name */
 	setprogname(argv[0]);
-	token.string = NULL;
 
 	/* check command-line argument and open file */
 	if (argc != 2) {
@@ -62,14 +61,15 @@ void print_token(Token *token)
 {
 	switch (token->type) {
 		case TOKEN_ID:
-			printf("Identifier: '%s'\n", token->lexeme);
+			printf("Identifier: '%.*s'\n", (int) token->span.length,
+					get_lexeme(token));
 			break;
 		case TOKEN_NUMBER:
 			printf("Number: %d\n", token->value);
 			break;
 		case TOKEN_STRING:
-			printf("String: \"%s\"\n", token->string);
-			free(token->string);
+			printf("String: \"%.*s\"\n", (int) token->span.length,
+					get_lexeme(token));
 			break;
 		default:
 			printf("%s\n", get_token_string(token->type));
@@ -13,10 +13,11 @@ static char *token_names[] = {
 	"end-of-file", "identifier", "numeric literal", "string literal", "'array'",
 	"'begin'", "'boolean'", "'call'", "'do'", "'else'", "'elsif'", "'end'",
 	"'false'", "'function'", "'get'", "'if'", "'integer'", "'leave'", "'not'",
-	"'put'", "'relax'", "'source'", "'then'", "'to'", "'true'", "'while'",
+	"'parallel'", "'put'", "'relax'", "'source'", "'then'", "'to'", "'true'",
+	"'while'",
 	"'='", "'>='", "'>'", "'<='", "'<'", "'<>'", "'-'", "'or'", "'+'", "'and'",
 	"'/'", "'*'", "'rem'", "']'", "')'", "','", "'.'", "':='", "'['", "'('",
-	"';'"
+	"'..'", "';'"
 };
 
 /* --- functions ------------------------------------------------------------ */
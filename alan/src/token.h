@@ -39,6 +39,7 @@ typedef enum {
 	TOKEN_INTEGER,
 	TOKEN_LEAVE,
 	TOKEN_NOT,
+	TOKEN_PARALLEL,
 	TOKEN_PUT,
 	TOKEN_RELAX,
 	TOKEN_SOURCE,
@@ -76,17 +77,24 @@ typedef enum {
 	TOKEN_GETS,
 	TOKEN_OPEN_BRACKET,
 	TOKEN_OPEN_PARENTHESIS,
+	TOKEN_RANGE,
 	TOKEN_SEMICOLON
 
 } TokenType;
 
+/** a stretch of the source text */
+typedef struct {
+	unsigned int  offset;                 /**< where the text starts        */
+	unsigned int  length;                 /**< the number of characters     */
+} Span;
+
 /** the token data type */
 typedef struct {
 	TokenType  type;                        /**< the type of the token        */
 	union {
 		int    value;                      /**< numeric value (for integers) */
-		char   lexeme[MAX_ID_LENGTH+1];    /**< lexeme for identifiers       */
-		char  *string;                     /**< string (for write)           */
+		Span   span;                       /**< lexeme for identifiers, and
+		                                        text for strings (for write) */
 	};
 } Token;
 
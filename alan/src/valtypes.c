@@ -11,7 +11,9 @@
 static char *valtype_names[] = {
 	"none", "**error**", "boolean", "boolean array", "integer", "integer array",
 	"**error**", "**error**", "procedure", "**error**", "boolean function",
-	"boolean array function", "integer function", "integer array function"
+	"boolean array function", "integer function", "integer array function",
+	"**error**", "**error**", "**error**", "**error**", "boolean slice",
+	"**error**", "integer slice"
 };
 
 #define NUM_TYPES (sizeof(valtype_names) / sizeof(char *))
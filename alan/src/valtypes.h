@@ -13,7 +13,8 @@ typedef enum valtype {
 	TYPE_ARRAY    = 1,
 	TYPE_BOOLEAN  = 2,
 	TYPE_INTEGER  = 4,
-	TYPE_CALLABLE = 8
+	TYPE_CALLABLE = 8,
+	TYPE_SLICE    = 16
 } ValType;
 
 #define IS_ARRAY(type)          (IS_ARRAY_TYPE(type) && !IS_CALLABLE_TYPE(type))
@@ -23,12 +24,14 @@ typedef enum valtype {
 #define IS_FUNCTION(type)       (IS_CALLABLE_TYPE(type) && !IS_PROCEDURE(type))
 #define IS_INTEGER_TYPE(type)   ((type) & TYPE_INTEGER)
 #define IS_PROCEDURE(type)      (IS_CALLABLE_TYPE(type))
+#define IS_SLICE_TYPE(type)     ((type) & TYPE_SLICE)
 #define IS_VARIABLE(type) \
 (!IS_CALLABLE_TYPE(type) && (IS_INTEGER_TYPE(type) || IS_BOOLEAN_TYPE(type)))
 
 #define SET_AS_ARRAY(type)      ((type) |= TYPE_ARRAY)
 #define SET_AS_CALLABLE(type)   ((type) |= TYPE_CALLABLE)
 #define SET_BASE_TYPE(type)     ((type) &= ~TYPE_ARRAY)
+#define SET_AS_SLICE(type)      ((type) |= TYPE_SLICE)
 #define SET_RETURN_TYPE(type)   ((type) &= ~TYPE_CALLABLE)
 
 /**
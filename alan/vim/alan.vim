@@ -12,8 +12,8 @@ syn keyword	alanBoolean				false true
 syn keyword	alanConditional			else elsif if
 syn keyword	alanFunction			get put
 syn keyword	alanOperator			and not or
-syn keyword	alanOperator			= <> < > <= >= + - * / rem := .
-syn keyword	alanRepeat				while
+syn keyword	alanOperator			= <> < > <= >= + - * / rem := . ..
+syn keyword	alanRepeat				parallel while
 syn keyword	alanBlockStatement		begin do end then
 syn keyword	alanDefineStatement		function source to
 syn keyword	alanStatement			call leave relax